@@ -43,16 +43,21 @@ namespace keystone
 {
 	ks_struct* get_handle()
 	{
-		// Keystone engine is not created until the first call.
+		// Keystone engines are not safe for concurrent use, so each thread creates 
+		// its own engine upon the first call and closes it when it exits.
 		//
-		static ks_engine* handle = [ ] ()
+		struct handle_entry
 		{
 			ks_engine* handle;
-			if ( ks_open( KS_ARCH_X86, KS_MODE_64, &handle ) != KS_ERR_OK )
-				throw std::exception( "Failed to create the Keystone engine!" );
-			return handle;
-		}( );
-		return handle;
+			handle_entry()
+			{
+				if ( ks_open( KS_ARCH_X86, KS_MODE_64, &handle ) != KS_ERR_OK )
+					throw std::exception( "Failed to create the Keystone engine!" );
+			}
+			~handle_entry() { ks_close( handle ); }
+		};
+		static thread_local handle_entry entry;
+		return entry.handle;
 	}
 
 	std::vector<uint8_t> assemble( const std::string& src, uint64_t va )
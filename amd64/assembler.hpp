@@ -45,6 +45,8 @@
 struct ks_struct;
 namespace keystone
 {
+	// Returns the Keystone engine of the current thread.
+	//
 	ks_struct* get_handle();
 	std::vector<uint8_t> assemble( const std::string& src, uint64_t va = 0 );
 };
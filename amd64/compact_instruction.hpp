@@ -0,0 +1,158 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+
+// Furthermore, the following pieces of software have additional copyrights
+// licenses, and/or restrictions:
+//
+// |--------------------------------------------------------------------------|
+// | File name               | Link for further information                   |
+// |-------------------------|------------------------------------------------|
+// | amd64/*                 | https://github.com/aquynh/capstone/            |
+// |                         | https://github.com/keystone-engine/keystone/   |
+// |--------------------------------------------------------------------------|
+//
+#pragma once
+#include <stdint.h>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <capstone/capstone.h>
+#include "..\util\interned_string.hpp"
+#include "id_mask.hpp"
+
+namespace vtil::amd64
+{
+	struct instruction;
+
+	// Compact, trivially-copyable representation of a decoded instruction holding the
+	// same information as amd64::instruction without any heap allocations.
+	// - Operand string is not kept, it is left empty upon conversion.
+	//
+	struct compact_instruction
+	{
+		static constexpr size_t max_length = 16;
+		static constexpr size_t max_operands = 8;
+
+		// Data copied from base of [cs_insn], mnemonic is interned so the 
+		// record only holds a pointer to the shared entry.
+		//
+		uint64_t address;
+		uint32_t id;
+		uint8_t length;
+		uint8_t bytes[ max_length ];
+		interned_string mnemonic;
+
+		// Data copied from [cs_insn::detail].
+		//
+		register_mask regs_read;
+		register_mask regs_write;
+		group_mask groups;
+
+		// Data copied from [cs_insn::detail::x86]
+		//
+		uint8_t prefix[ 4 ];
+		uint8_t opcode[ 4 ];
+		uint8_t opcode_length;
+
+		uint8_t rex;
+		uint8_t addr_size;
+		uint8_t modrm;
+		uint8_t sib;
+		int64_t disp;
+
+		x86_reg sib_index;
+		int8_t sib_scale;
+		x86_reg sib_base;
+
+		x86_xop_cc xop_cc;
+		x86_sse_cc sse_cc;
+		x86_avx_cc avx_cc;
+
+		bool avx_sae;
+		x86_avx_rm avx_rm;
+		uint64_t eflags;
+
+		uint8_t operand_count;
+		cs_x86_op operands[ max_operands ];
+		cs_x86_encoding encoding;
+
+		// Fills the record from the output of Capstone, detail must be enabled.
+		//
+		void assign( const cs_insn& in )
+		{
+			address = in.address;
+			id = in.id;
+			length = ( uint8_t ) std::min<size_t>( in.size, max_length );
+			memcpy( bytes, in.bytes, length );
+			mnemonic = intern( in.mnemonic );
+
+			regs_read = {};
+			regs_write = {};
+			groups = {};
+			for ( size_t i = 0; i != in.detail->regs_read_count; i++ )
+				regs_read.set( in.detail->regs_read[ i ] );
+			for ( size_t i = 0; i != in.detail->regs_write_count; i++ )
+				regs_write.set( in.detail->regs_write[ i ] );
+			for ( size_t i = 0; i != in.detail->groups_count; i++ )
+				groups.set( in.detail->groups[ i ] );
+
+			const cs_x86& x86 = in.detail->x86;
+			memcpy( prefix, x86.prefix, sizeof( prefix ) );
+			memcpy( opcode, x86.opcode, sizeof( opcode ) );
+			opcode_length = 0;
+			while ( opcode_length < 4 && opcode[ opcode_length ] != 0x0 )
+				opcode_length++;
+			rex = x86.rex;
+			addr_size = x86.addr_size;
+			modrm = x86.modrm;
+			sib = x86.sib;
+			disp = x86.disp;
+			sib_index = x86.sib_index;
+			sib_scale = x86.sib_scale;
+			sib_base = x86.sib_base;
+			xop_cc = x86.xop_cc;
+			sse_cc = x86.sse_cc;
+			avx_cc = x86.avx_cc;
+			avx_sae = x86.avx_sae;
+			avx_rm = x86.avx_rm;
+			eflags = x86.eflags;
+			operand_count = std::min<uint8_t>( x86.op_count, max_operands );
+			memcpy( operands, x86.operands, operand_count * sizeof( cs_x86_op ) );
+			encoding = x86.encoding;
+		}
+
+		// Converts the record into the full instruction.
+		//
+		instruction to_instruction() const;
+
+		// Helper to check if instruction belongs to the given group.
+		//
+		bool in_group( uint8_t group_searched ) const { return groups.test( group_searched ); }
+	};
+	static_assert( std::is_trivially_copyable_v<compact_instruction>, "Compact instruction must be trivially copyable." );
+};
\ No newline at end of file
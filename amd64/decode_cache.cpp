@@ -0,0 +1,225 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+
+// Furthermore, the following pieces of software have additional copyrights
+// licenses, and/or restrictions:
+//
+// |--------------------------------------------------------------------------|
+// | File name               | Link for further information                   |
+// |-------------------------|------------------------------------------------|
+// | amd64/*                 | https://github.com/aquynh/capstone/            |
+// |                         | https://github.com/keystone-engine/keystone/   |
+// |--------------------------------------------------------------------------|
+//
+#include "decode_cache.hpp"
+#include <cstring>
+#include <mutex>
+#include <algorithm>
+#include "..\util\memory_accounting.hpp"
+
+namespace vtil::amd64
+{
+	// Splits the capacity between the shards.
+	//
+	decode_cache::decode_cache( size_t capacity )
+	{
+		for ( shard& s : shards )
+		{
+			s.capacity = std::max<size_t>( 1, ( capacity + shard_count - 1 ) / shard_count );
+			s.slots = std::make_unique<entry[]>( s.capacity );
+			s.index.reserve( s.capacity );
+		}
+	}
+
+	// Returns the instruction at the given address decoding at most [size] bytes.
+	//
+	std::shared_ptr<const instruction> decode_cache::decode( const void* bytes, uint64_t address, size_t size )
+	{
+		shard& s = shard_of( address );
+
+		// Look up the address holding only the shared lock, the entry is only served
+		// if the bytes it was decoded from are still the same.
+		//
+		{
+			std::shared_lock g( s.mutex );
+			auto it = s.index.find( address );
+			if ( it != s.index.end() )
+			{
+				entry& e = s.slots[ it->second ];
+				const std::vector<uint8_t>& cached = e.value->bytes;
+				if ( cached.size() <= size && !memcmp( cached.data(), bytes, cached.size() ) )
+				{
+					if ( !e.referenced.load( std::memory_order_relaxed ) )
+						e.referenced.store( true, std::memory_order_relaxed );
+					s.hits.fetch_add( 1, std::memory_order_relaxed );
+					return e.value;
+				}
+			}
+		}
+
+		// Decode the instruction without holding any locks and insert it.
+		//
+		s.misses.fetch_add( 1, std::memory_order_relaxed );
+		std::shared_ptr<const instruction> result;
+		capstone::disasm_stream( bytes, address, size, [ & ] ( const cs_insn& in )
+		{
+			result = memory::make_tracked_shared<memory::memory_tag::disassembly, instruction>( capstone::convert( in ) );
+		}, 1 );
+		if ( result )
+		{
+			std::unique_lock g( s.mutex );
+			insert( s, address, result );
+		}
+		return result;
+	}
+
+	// Inserts or replaces the entry of the address, evicting an entry that was not
+	// referenced since the last pass of the hand if the shard is full.
+	//
+	void decode_cache::insert( shard& s, uint64_t address, std::shared_ptr<const instruction> value )
+	{
+		// If there is an entry already, the bytes have changed, replace it.
+		//
+		if ( auto it = s.index.find( address ); it != s.index.end() )
+		{
+			s.slots[ it->second ].value = std::move( value );
+			return;
+		}
+
+		// Pick a slot that was never used, otherwise sweep the hand until an empty 
+		// or an unreferenced slot is found.
+		//
+		size_t slot;
+		if ( s.used != s.capacity )
+		{
+			slot = s.used++;
+		}
+		else
+		{
+			while ( true )
+			{
+				entry& e = s.slots[ s.hand ];
+				slot = s.hand;
+				s.hand = ( s.hand + 1 ) % s.capacity;
+
+				if ( !e.value )
+					break;
+				if ( !e.referenced.exchange( false, std::memory_order_relaxed ) )
+				{
+					s.index.erase( e.value->address );
+					s.evictions.fetch_add( 1, std::memory_order_relaxed );
+					break;
+				}
+			}
+		}
+
+		entry& e = s.slots[ slot ];
+		e.value = std::move( value );
+		e.referenced.store( false, std::memory_order_relaxed );
+		s.index.emplace( address, slot );
+	}
+
+	// Removes the entry of the address if there is one.
+	//
+	void decode_cache::erase( shard& s, uint64_t address )
+	{
+		if ( auto it = s.index.find( address ); it != s.index.end() )
+		{
+			s.slots[ it->second ].value = nullptr;
+			s.index.erase( it );
+			s.invalidations.fetch_add( 1, std::memory_order_relaxed );
+		}
+	}
+
+	// Removes every instruction overlapping the given range.
+	//
+	void decode_cache::invalidate( uint64_t address, size_t size )
+	{
+		// Instructions starting up to 14 bytes before the range may overlap it.
+		//
+		static constexpr size_t max_length = 15;
+		uint64_t first = address >= ( max_length - 1 ) ? address - ( max_length - 1 ) : 0;
+		uint64_t last = address + size;
+
+		for ( shard& s : shards )
+		{
+			std::unique_lock g( s.mutex );
+
+			// If the range is smaller than the shard, look up each address, otherwise scan every entry.
+			//
+			if ( ( last - first ) <= s.index.size() )
+			{
+				for ( uint64_t it = first; it != last; it++ )
+				{
+					if ( &shard_of( it ) != &s )
+						continue;
+					auto entry_it = s.index.find( it );
+					if ( entry_it != s.index.end() && it + s.slots[ entry_it->second ].value->bytes.size() > address )
+						erase( s, it );
+				}
+			}
+			else
+			{
+				std::vector<uint64_t> overlapping;
+				for ( auto& [start, slot] : s.index )
+					if ( start < last && start + s.slots[ slot ].value->bytes.size() > address )
+						overlapping.push_back( start );
+				for ( uint64_t start : overlapping )
+					erase( s, start );
+			}
+		}
+	}
+
+	// Removes every instruction.
+	//
+	void decode_cache::clear()
+	{
+		for ( shard& s : shards )
+		{
+			std::unique_lock g( s.mutex );
+			for ( auto& [start, slot] : s.index )
+				s.slots[ slot ].value = nullptr;
+			s.index.clear();
+		}
+	}
+
+	// Returns the statistics summed over every shard.
+	//
+	decode_cache::statistics decode_cache::stats() const
+	{
+		statistics result;
+		for ( const shard& s : shards )
+		{
+			result.hits += s.hits.load( std::memory_order_relaxed );
+			result.misses += s.misses.load( std::memory_order_relaxed );
+			result.evictions += s.evictions.load( std::memory_order_relaxed );
+			result.invalidations += s.invalidations.load( std::memory_order_relaxed );
+		}
+		return result;
+	}
+};
\ No newline at end of file
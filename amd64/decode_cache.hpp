@@ -0,0 +1,127 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+
+// Furthermore, the following pieces of software have additional copyrights
+// licenses, and/or restrictions:
+//
+// |--------------------------------------------------------------------------|
+// | File name               | Link for further information                   |
+// |-------------------------|------------------------------------------------|
+// | amd64/*                 | https://github.com/aquynh/capstone/            |
+// |                         | https://github.com/keystone-engine/keystone/   |
+// |--------------------------------------------------------------------------|
+//
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_map>
+#include "disassembly.hpp"
+
+namespace vtil::amd64
+{
+	// Bounded cache of decoded instructions safe for concurrent use, entries are keyed by the
+	// address and validated against the bytes given so that modified code is never served.
+	// - Split into shards by the address, each with its own reader-writer lock and its 
+	//   own CLOCK eviction so that hits only take the shared lock.
+	//
+	struct decode_cache
+	{
+		static constexpr size_t shard_count = 16;
+
+		// Statistics of the cache.
+		//
+		struct statistics
+		{
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint64_t evictions = 0;
+			uint64_t invalidations = 0;
+			double hit_rate() const { return ( hits + misses ) ? double( hits ) / ( hits + misses ) : 0; }
+		};
+
+		// Cached instruction and the reference bit used by the eviction.
+		//
+		struct entry
+		{
+			std::shared_ptr<const instruction> value;
+			std::atomic<bool> referenced = false;
+		};
+
+		// Each shard holds a fixed number of slots, the map points to the slot of each address.
+		//
+		struct alignas( 64 ) shard
+		{
+			mutable std::shared_mutex mutex;
+			std::unordered_map<uint64_t, size_t> index;
+			std::unique_ptr<entry[]> slots;
+			size_t capacity = 0;
+			size_t used = 0;
+			size_t hand = 0;
+
+			std::atomic<uint64_t> hits = 0;
+			std::atomic<uint64_t> misses = 0;
+			std::atomic<uint64_t> evictions = 0;
+			std::atomic<uint64_t> invalidations = 0;
+		};
+		shard shards[ shard_count ];
+
+		// Constructed with the maximum number of instructions cached, copying or moving this object is not allowed.
+		//
+		decode_cache( size_t capacity = 64 * 1024 );
+		decode_cache( decode_cache&& ) = delete;
+		decode_cache( const decode_cache& ) = delete;
+		decode_cache& operator=( decode_cache&& ) = delete;
+		decode_cache& operator=( const decode_cache& ) = delete;
+
+		// Returns the instruction at the given address decoding at most [size] bytes, the cached
+		// instruction is returned if its bytes match, nullptr if the bytes cannot be decoded.
+		//
+		std::shared_ptr<const instruction> decode( const void* bytes, uint64_t address, size_t size = 15 );
+
+		// Removes every instruction overlapping the given range, should be invoked when the code is modified.
+		//
+		void invalidate( uint64_t address, size_t size );
+
+		// Removes every instruction.
+		//
+		void clear();
+
+		// Returns the statistics.
+		//
+		statistics stats() const;
+
+		// Internal helpers, locks are expected to be held by the caller.
+		//
+		shard& shard_of( uint64_t address ) { return shards[ ( address ^ ( address >> 7 ) ) % shard_count ]; }
+		void insert( shard& s, uint64_t address, std::shared_ptr<const instruction> value );
+		void erase( shard& s, uint64_t address );
+	};
+};
\ No newline at end of file
@@ -37,92 +37,236 @@
 // |--------------------------------------------------------------------------|
 //
 #include "disassembly.hpp"
+#include "..\io\asserts.hpp"
 
 namespace capstone
 {
-	csh get_handle()
+	csh get_handle( bool detail )
 	{
-		// Capstone engine is not created until the first call.
+		// Capstone engines are not safe for concurrent use, so each thread creates 
+		// its own engines upon the first call and closes them when it exits.
 		//
-		static csh handle = [ ] ()
+		struct handle_entry
 		{
 			csh handle;
-			if ( cs_open( CS_ARCH_X86, CS_MODE_64, &handle ) != CS_ERR_OK 
-				 || cs_option( handle, CS_OPT_DETAIL, CS_OPT_ON ) != CS_ERR_OK )
-				throw std::exception( "Failed to create the Capstone engine!" );
-			return handle;
-		}( );
-		return handle;
+			handle_entry( bool detail )
+			{
+				if ( cs_open( CS_ARCH_X86, CS_MODE_64, &handle ) != CS_ERR_OK 
+					 || cs_option( handle, CS_OPT_DETAIL, detail ? CS_OPT_ON : CS_OPT_OFF ) != CS_ERR_OK )
+					throw std::exception( "Failed to create the Capstone engine!" );
+			}
+			~handle_entry() { cs_close( &handle ); }
+		};
+		if ( detail )
+		{
+			static thread_local handle_entry entry{ true };
+			return entry.handle;
+		}
+		else
+		{
+			static thread_local handle_entry entry{ false };
+			return entry.handle;
+		}
 	}
 
-	std::vector<vtil::amd64::instruction> disasm( const void* bytes, uint64_t address, size_t size, size_t count )
+	// Stacks of instruction buffers of the current thread, one per engine as buffers allocated
+	// by the engine without detail have no room for it. Buffers are kept for reuse up to the 
+	// maximum depth, deeper nesting allocates temporary ones.
+	//
+	struct buffer_stack
+	{
+		static constexpr size_t max_depth = 4;
+		cs_insn* buffers[ max_depth ] = {};
+		size_t depth = 0;
+
+		~buffer_stack()
+		{
+			for ( cs_insn* insn : buffers )
+				if ( insn ) cs_free( insn, 1 );
+		}
+	};
+	static thread_local buffer_stack local_buffers[ 2 ];
+
+	// Borrows the next buffer from the stack of the current thread.
+	//
+	impl::buffer_lease::buffer_lease( bool detail ) : detail( detail )
+	{
+		buffer_stack& stack = local_buffers[ detail ];
+		size_t depth = stack.depth++;
+		if ( depth >= buffer_stack::max_depth )
+			insn = cs_malloc( get_handle( detail ) );
+		else if ( !( insn = stack.buffers[ depth ] ) )
+			insn = stack.buffers[ depth ] = cs_malloc( get_handle( detail ) );
+	}
+	impl::buffer_lease::~buffer_lease()
 	{
-		// Disasemble the instruction.
+		if ( --local_buffers[ detail ].depth >= buffer_stack::max_depth )
+			cs_free( insn, 1 );
+	}
+
+	// Converts the output of Capstone into vtil::amd64 format.
+	//
+	vtil::amd64::instruction convert( const cs_insn& in )
+	{
+		vtil::amd64::instruction out;
+
+		// Copy cs_insn base.
+		//
+		out.id = in.id;
+		out.address = in.address;
+		out.mnemonic = vtil::intern( in.mnemonic );
+		out.operand_string = in.op_str;
+		out.bytes = { in.bytes, in.bytes + in.size };
+
+		// Copy cs_insn::detail.
 		//
-		cs_insn* ins;
-		count = cs_disasm
-		(
-			get_handle(),
-			( uint8_t* ) bytes,
-			size ? size : -1,
-			address,
-			size ? 0 : count,
-			&ins
-		);
-
-		// Convert each output into vtil::amd64 format and push it to a vector.
+		out.regs_read = { in.detail->regs_read, in.detail->regs_read + in.detail->regs_read_count };
+		out.regs_write = { in.detail->regs_write, in.detail->regs_write + in.detail->regs_write_count };
+		out.groups = { in.detail->groups, in.detail->groups + in.detail->groups_count };
+
+		// Copy cs_insn::detail::x86.
+		//
+		std::copy( std::begin( in.detail->x86.prefix ), std::end( in.detail->x86.prefix ), out.prefix );
+		for ( int i = 0; i < 4 && in.detail->x86.opcode[ i ] != 0x0; i++ )
+			out.opcode.push_back( in.detail->x86.opcode[ i ] );
+		out.rex = in.detail->x86.rex;
+		out.addr_size = in.detail->x86.addr_size;
+		out.modrm = in.detail->x86.modrm;
+		out.sib = in.detail->x86.sib;
+		out.disp = in.detail->x86.disp;
+		out.sib_index = in.detail->x86.sib_index;
+		out.sib_scale = in.detail->x86.sib_scale;
+		out.sib_base = in.detail->x86.sib_base;
+		out.xop_cc = in.detail->x86.xop_cc;
+		out.sse_cc = in.detail->x86.sse_cc;
+		out.avx_cc = in.detail->x86.avx_cc;
+		out.avx_sae = in.detail->x86.avx_sae;
+		out.avx_rm = in.detail->x86.avx_rm;
+		out.eflags = in.detail->x86.eflags;
+		out.operands = { in.detail->x86.operands, in.detail->x86.operands + in.detail->x86.op_count };
+		out.encoding = in.detail->x86.encoding;
+		return out;
+	}
+
+	std::vector<vtil::amd64::instruction> disasm( const void* bytes, uint64_t address, size_t size, size_t count )
+	{
+		// Stream each instruction into the vector after converting it.
 		//
 		std::vector<vtil::amd64::instruction> vec;
-		for ( int i = 0; i < count; i++ )
+		disasm_stream( bytes, address, size ? size : -1, [ & ] ( const cs_insn& in )
 		{
-			vtil::amd64::instruction out;
-			cs_insn& in = ins[ i ];
-
-			// Copy cs_insn base.
-			//
-			out.id = in.id;
-			out.address = in.address;
-			out.mnemonic = in.mnemonic;
-			out.operand_string = in.op_str;
-			out.bytes = { in.bytes, in.bytes + in.size };
-
-			// Copy cs_insn::detail.
-			//
-			out.regs_read = { in.detail->regs_read, in.detail->regs_read + in.detail->regs_read_count };
-			out.regs_write = { in.detail->regs_write, in.detail->regs_write + in.detail->regs_write_count };
-			out.groups = { in.detail->groups, in.detail->groups + in.detail->groups_count };
-
-			// Copy cs_insn::detail::x86.
-			//
-			std::copy( std::begin( in.detail->x86.prefix ), std::end( in.detail->x86.prefix ), out.prefix );
-			for ( int i = 0; i < 4 && in.detail->x86.opcode[ i ] != 0x0; i++ )
-				out.opcode.push_back( in.detail->x86.opcode[ i ] );
-			out.rex = in.detail->x86.rex;
-			out.addr_size = in.detail->x86.addr_size;
-			out.modrm = in.detail->x86.modrm;
-			out.sib = in.detail->x86.sib;
-			out.disp = in.detail->x86.disp;
-			out.sib_index = in.detail->x86.sib_index;
-			out.sib_scale = in.detail->x86.sib_scale;
-			out.sib_base = in.detail->x86.sib_base;
-			out.xop_cc = in.detail->x86.xop_cc;
-			out.sse_cc = in.detail->x86.sse_cc;
-			out.avx_cc = in.detail->x86.avx_cc;
-			out.avx_sae = in.detail->x86.avx_sae;
-			out.avx_rm = in.detail->x86.avx_rm;
-			out.eflags = in.detail->x86.eflags;
-			out.operands = { in.detail->x86.operands, in.detail->x86.operands + in.detail->x86.op_count };
-			out.encoding = in.detail->x86.encoding;
-
-			// Push it to up the vector.
-			//
-			vec.push_back( std::move( out ) );
-		}
+			vec.push_back( convert( in ) );
+		}, size ? 0 : count );
+		return vec;
+	}
 
-		// Free the output from Capstone and return the vector.
+	size_t disasm_compact( std::vector<vtil::amd64::compact_instruction>& out, const void* bytes, uint64_t address, size_t size, size_t count )
+	{
+		// Fill the records in place as they are decoded.
 		//
-		cs_free( ins, count );
-		return vec;
+		return disasm_stream( bytes, address, size ? size : -1, [ & ] ( const cs_insn& in )
+		{
+			out.emplace_back().assign( in );
+		}, size ? 0 : count );
 	}
 
+	size_t disasm_lite( std::vector<vtil::amd64::lazy_instruction>& out, const void* bytes, uint64_t address, size_t size, size_t count )
+	{
+		// Fill the records in place as they are decoded without detail.
+		//
+		return disasm_stream( bytes, address, size ? size : -1, [ & ] ( const cs_insn& in )
+		{
+			vtil::amd64::lazy_instruction& ins = out.emplace_back();
+			ins.address = in.address;
+			ins.id = in.id;
+			ins.length = ( uint8_t ) std::min<size_t>( in.size, vtil::amd64::lazy_instruction::max_length );
+			memcpy( ins.bytes, in.bytes, ins.length );
+		}, size ? 0 : count, false );
+	}
+
+};
+
+namespace vtil::amd64
+{
+	// Decodes the instruction again with detail upon the first call.
+	//
+	const instruction& lazy_instruction::detail() const
+	{
+		if ( !detailed )
+		{
+			capstone::disasm_stream( bytes, address, length, [ & ] ( const cs_insn& in )
+			{
+				detailed = std::make_shared<const instruction>( capstone::convert( in ) );
+			}, 1 );
+			fcheck( detailed );
+		}
+		return *detailed;
+	}
+
+	// Converts the compact record into the full instruction.
+	//
+	instruction compact_instruction::to_instruction() const
+	{
+		instruction out;
+		out.id = id;
+		out.address = address;
+		out.bytes = { bytes, bytes + length };
+		out.mnemonic = mnemonic;
+		out.regs_read = regs_read;
+		out.regs_write = regs_write;
+		out.groups = groups;
+		std::copy( std::begin( prefix ), std::end( prefix ), out.prefix );
+		out.opcode = { opcode, opcode + opcode_length };
+		out.rex = rex;
+		out.addr_size = addr_size;
+		out.modrm = modrm;
+		out.sib = sib;
+		out.disp = disp;
+		out.sib_index = sib_index;
+		out.sib_scale = sib_scale;
+		out.sib_base = sib_base;
+		out.xop_cc = xop_cc;
+		out.sse_cc = sse_cc;
+		out.avx_cc = avx_cc;
+		out.avx_sae = avx_sae;
+		out.avx_rm = avx_rm;
+		out.eflags = eflags;
+		out.operands = { operands, operands + operand_count };
+		out.encoding = encoding;
+		return out;
+	}
+
+	// Converts the record back into an instruction.
+	//
+	instruction instruction_record::to_instruction() const
+	{
+		instruction out;
+		out.id = id;
+		out.address = address;
+		out.bytes = bytes.to_vector();
+		out.mnemonic = intern( mnemonic.view() );
+		out.operand_string = operand_string.view();
+		out.regs_read = { regs_read.begin(), regs_read.end() };
+		out.regs_write = { regs_write.begin(), regs_write.end() };
+		out.groups = { groups.begin(), groups.end() };
+		std::copy( std::begin( prefix ), std::end( prefix ), out.prefix );
+		out.opcode = opcode.to_vector();
+		out.rex = rex;
+		out.addr_size = addr_size;
+		out.modrm = modrm;
+		out.sib = sib;
+		out.disp = disp;
+		out.sib_index = sib_index;
+		out.sib_scale = sib_scale;
+		out.sib_base = sib_base;
+		out.xop_cc = xop_cc;
+		out.sse_cc = sse_cc;
+		out.avx_cc = avx_cc;
+		out.avx_sae = avx_sae;
+		out.avx_rm = avx_rm;
+		out.eflags = eflags;
+		out.operands = operands.to_vector();
+		out.encoding = encoding;
+		return out;
+	}
 };
\ No newline at end of file
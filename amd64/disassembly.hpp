@@ -41,9 +41,12 @@
 #include <map>
 #include <string>
 #include <cstring>
-#include <set>
+#include <memory>
 #include <capstone/capstone.h>
 #include "..\io\formatting.hpp"
+#include "..\util\interned_string.hpp"
+#include "..\io\serialization.hpp"
+#include "compact_instruction.hpp"
 
 namespace vtil::amd64
 {
@@ -54,14 +57,14 @@ namespace vtil::amd64
 		uint32_t id = 0;
 		uint64_t address = 0;
 		std::vector<uint8_t> bytes;
-		std::string mnemonic;
+		interned_string mnemonic;
 		std::string operand_string;
 
 		// Data copied from [cs_insn::detail].
 		//
-		std::set<uint16_t> regs_read;
-		std::set<uint16_t> regs_write;
-		std::set<uint8_t> groups;
+		register_mask regs_read;
+		register_mask regs_write;
+		group_mask groups;
 
 		// Data copied from [cs_insn::detail::x86]
 		//
@@ -117,7 +120,123 @@ namespace vtil::amd64
 		//
 		bool in_group( uint8_t group_searched ) const
 		{
-			return std::find( groups.begin(), groups.end(), group_searched ) != groups.end();
+			return groups.test( group_searched );
+		}
+	};
+	// Lightweight record of an instruction decoded without detail, holding only the 
+	// address, the identifier and the bytes. Rest of the instruction is decoded 
+	// again from the bytes upon the first request.
+	// - Materialization is not synchronized, the same record should not be accessed
+	//   from multiple threads until ::detail() was invoked once.
+	//
+	struct lazy_instruction
+	{
+		static constexpr size_t max_length = 16;
+
+		uint64_t address = 0;
+		uint32_t id = 0;
+		uint8_t length = 0;
+		uint8_t bytes[ max_length ];
+		mutable std::shared_ptr<const instruction> detailed;
+
+		// Returns the instruction with detail, decoding it if not done already.
+		//
+		const instruction& detail() const;
+
+		// Accessors of the fields that require detail.
+		//
+		const std::vector<cs_x86_op>& operands() const { return detail().operands; }
+		const register_mask& regs_read() const { return detail().regs_read; }
+		const register_mask& regs_write() const { return detail().regs_write; }
+		bool in_group( uint8_t group_searched ) const { return detail().in_group( group_searched ); }
+	};
+
+	// Flat record of an instruction as stored in serialized blobs, fields can be
+	// accessed in place and ::to_instruction() materializes the full instruction.
+	//
+	struct instruction_record
+	{
+		uint32_t id;
+		uint64_t address;
+		serialization::rel_array<uint8_t> bytes;
+		serialization::rel_string mnemonic;
+		serialization::rel_string operand_string;
+
+		serialization::rel_array<uint16_t> regs_read;
+		serialization::rel_array<uint16_t> regs_write;
+		serialization::rel_array<uint8_t> groups;
+
+		uint8_t prefix[ 4 ];
+		serialization::rel_array<uint8_t> opcode;
+
+		uint8_t rex;
+		uint8_t addr_size;
+		uint8_t modrm;
+		uint8_t sib;
+		int64_t disp;
+
+		x86_reg sib_index;
+		int8_t sib_scale;
+		x86_reg sib_base;
+
+		x86_xop_cc xop_cc;
+		x86_sse_cc sse_cc;
+		x86_avx_cc avx_cc;
+
+		bool avx_sae;
+		x86_avx_rm avx_rm;
+		uint64_t eflags;
+
+		serialization::rel_array<cs_x86_op> operands;
+		cs_x86_encoding encoding;
+
+		// Converts the record back into an instruction.
+		//
+		instruction to_instruction() const;
+	};
+};
+
+// Instructions are serialized as instruction records.
+//
+namespace vtil::serialization
+{
+	template<>
+	struct serializer<amd64::instruction>
+	{
+		using record_type = amd64::instruction_record;
+
+		static void write( blob_writer& out, size_t record, const amd64::instruction& value )
+		{
+			// Copy the fixed fields first as the record pointer is invalidated by the arrays.
+			//
+			record_type* r = out.at<record_type>( record );
+			r->id = value.id;
+			r->address = value.address;
+			std::copy( std::begin( value.prefix ), std::end( value.prefix ), r->prefix );
+			r->rex = value.rex;
+			r->addr_size = value.addr_size;
+			r->modrm = value.modrm;
+			r->sib = value.sib;
+			r->disp = value.disp;
+			r->sib_index = value.sib_index;
+			r->sib_scale = value.sib_scale;
+			r->sib_base = value.sib_base;
+			r->xop_cc = value.xop_cc;
+			r->sse_cc = value.sse_cc;
+			r->avx_cc = value.avx_cc;
+			r->avx_sae = value.avx_sae;
+			r->avx_rm = value.avx_rm;
+			r->eflags = value.eflags;
+			r->encoding = value.encoding;
+
+			out.write_array( out.field_of( record, &record_type::bytes ), value.bytes );
+			out.write_string( out.field_of( record, &record_type::mnemonic ), value.mnemonic );
+			out.write_string( out.field_of( record, &record_type::operand_string ), value.operand_string );
+			out.write_array( out.field_of( record, &record_type::regs_read ), value.regs_read );
+			out.write_array( out.field_of( record, &record_type::regs_write ), value.regs_write );
+			out.write_array( out.field_of( record, &record_type::groups ), value.groups );
+			out.write_array( out.field_of( record, &record_type::opcode ), value.opcode );
+			out.write_array( out.field_of( record, &record_type::operands ), value.operands );
 		}
 	};
 };
@@ -126,6 +245,76 @@ namespace vtil::amd64
 //
 namespace capstone
 {
-	csh get_handle();
+	// Returns the Capstone engine of the current thread, with or without detail.
+	//
+	csh get_handle( bool detail = true );
+
+	namespace impl
+	{
+		// Borrows an instruction buffer allocated by Capstone from the stack of the current 
+		// thread for the lifetime of the object, so that decoding from within the callback of
+		// another decode does not overwrite the instruction the outer callback is using.
+		// - Buffers are allocated by the engine matching [detail], so decoding without detail
+		//   neither allocates detail nor creates the engine with detail.
+		//
+		struct buffer_lease
+		{
+			bool detail;
+			cs_insn* insn;
+
+			buffer_lease( bool detail );
+			~buffer_lease();
+			buffer_lease( buffer_lease&& ) = delete;
+			buffer_lease( const buffer_lease& ) = delete;
+		};
+	};
+
+	// Decodes the instructions one at a time into a reused buffer and passes each to the 
+	// callback, returns the number of instructions decoded.
+	// - Decoding stops after [count] instructions if non-zero, at the first invalid instruction
+	//   or if the callback returns false.
+	// - Instruction passed to the callback is only valid until it returns, the callback 
+	//   may decode recursively as nested calls are given a different buffer.
+	// - If [detail] is false, cs_insn::detail is not filled which makes decoding much faster.
+	//
+	template<typename fn_callback>
+	static size_t disasm_stream( const void* bytes, uint64_t address, size_t size, fn_callback&& callback, size_t count = 0, bool detail = true )
+	{
+		csh handle = get_handle( detail );
+		impl::buffer_lease lease{ detail };
+		cs_insn* insn = lease.insn;
+		const uint8_t* it = ( const uint8_t* ) bytes;
+
+		size_t n = 0;
+		while ( ( !count || n != count ) && cs_disasm_iter( handle, &it, &size, &address, insn ) )
+		{
+			n++;
+			if constexpr ( std::is_same_v<decltype( callback( *insn ) ), bool> )
+			{
+				if ( !callback( *insn ) )
+					break;
+			}
+			else
+			{
+				callback( *insn );
+			}
+		}
+		return n;
+	}
+
+	// Converts the output of Capstone into vtil::amd64 format, detail must be enabled.
+	//
+	vtil::amd64::instruction convert( const cs_insn& in );
+
 	std::vector<vtil::amd64::instruction> disasm( const void* bytes, uint64_t address, size_t size = 0, size_t count = 1 );
+
+	// Disassembles into compact records appended to [out] without allocating for each
+	// instruction, returns the number of instructions decoded.
+	//
+	size_t disasm_compact( std::vector<vtil::amd64::compact_instruction>& out, const void* bytes, uint64_t address, size_t size = 0, size_t count = 1 );
+
+	// Disassembles without detail into lightweight records appended to [out], returns the
+	// number of instructions decoded. Detail is decoded again only when requested.
+	//
+	size_t disasm_lite( std::vector<vtil::amd64::lazy_instruction>& out, const void* bytes, uint64_t address, size_t size = 0, size_t count = 1 );
 };
\ No newline at end of file
@@ -0,0 +1,725 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+
+// Furthermore, the following pieces of software have additional copyrights
+// licenses, and/or restrictions:
+//
+// |--------------------------------------------------------------------------|
+// | File name               | Link for further information                   |
+// |-------------------------|------------------------------------------------|
+// | amd64/*                 | https://github.com/aquynh/capstone/            |
+// |                         | https://github.com/keystone-engine/keystone/   |
+// |--------------------------------------------------------------------------|
+//
+#include "fast_decoder.hpp"
+#include <array>
+#include <atomic>
+#include <random>
+#include "disassembly.hpp"
+#include "..\io\formatting.hpp"
+
+namespace vtil::amd64
+{
+	namespace impl
+	{
+		// Operand forms of the opcodes handled natively.
+		//
+		enum class opcode_form : uint8_t
+		{
+			none,
+			rm_reg,       // op r/m, r
+			reg_rm,       // op r, r/m
+			acc_imm,      // op al/ax/eax/rax, imm
+			rm_imm,       // op r/m, imm with the identifier selected by ModRM.reg
+			rm_cl,        // op r/m, cl with the identifier selected by ModRM.reg
+			reg_imm,      // op r, imm with the register encoded in the opcode
+			stack_reg,    // op r64 with the register encoded in the opcode
+			relative,     // op rel8/rel32
+			ret,          // ret / ret imm16
+			lea,          // lea r, m
+			movzx,        // movzx r, r/m8 or r/m16
+		};
+
+		// Immediate kinds.
+		//
+		enum class imm_kind : uint8_t
+		{
+			none,
+			ib,           // imm8 sign-extended to the operand size
+			iz,           // imm16 if the operand size is 16 bits, imm32 sign-extended otherwise
+			iw,           // imm16
+			count,        // imm8 shift count
+			rel8,         // rel8 added to the address of the next instruction
+			rel32,        // rel32 added to the address of the next instruction
+		};
+
+		// Description of each opcode, groups are indexed with ModRM.reg.
+		//
+		struct opcode_entry
+		{
+			opcode_form form = opcode_form::none;
+			imm_kind imm = imm_kind::none;
+			x86_insn id = X86_INS_INVALID;
+			const x86_insn* group = nullptr;
+			bool byte_sized = false;
+			uint8_t access = 0;
+		};
+
+		static constexpr x86_insn alu_group[ 8 ] = { X86_INS_ADD, X86_INS_OR, X86_INS_INVALID, X86_INS_INVALID, X86_INS_AND, X86_INS_SUB, X86_INS_XOR, X86_INS_INVALID };
+		static constexpr x86_insn shift_group[ 8 ] = { X86_INS_INVALID, X86_INS_INVALID, X86_INS_INVALID, X86_INS_INVALID, X86_INS_SHL, X86_INS_SHR, X86_INS_INVALID, X86_INS_INVALID };
+		static constexpr x86_insn mov_group[ 8 ] = { X86_INS_MOV, X86_INS_INVALID, X86_INS_INVALID, X86_INS_INVALID, X86_INS_INVALID, X86_INS_INVALID, X86_INS_INVALID, X86_INS_INVALID };
+		static constexpr x86_insn jcc_table[ 16 ] = {
+			X86_INS_JO, X86_INS_JNO, X86_INS_JB, X86_INS_JAE, X86_INS_JE, X86_INS_JNE, X86_INS_JBE, X86_INS_JA,
+			X86_INS_JS, X86_INS_JNS, X86_INS_JP, X86_INS_JNP, X86_INS_JL, X86_INS_JGE, X86_INS_JLE, X86_INS_JG
+		};
+
+		static constexpr uint8_t ac_r = CS_AC_READ;
+		static constexpr uint8_t ac_w = CS_AC_WRITE;
+		static constexpr uint8_t ac_rw = CS_AC_READ | CS_AC_WRITE;
+
+		// Tables of the one-byte opcodes and the two-byte opcodes prefixed by 0x0F.
+		//
+		static constexpr std::array<opcode_entry, 256> one_byte_table = [ ] ()
+		{
+			std::array<opcode_entry, 256> t = {};
+			constexpr std::pair<uint8_t, x86_insn> alu[] = { { 0x00, X86_INS_ADD }, { 0x08, X86_INS_OR }, { 0x20, X86_INS_AND }, { 0x28, X86_INS_SUB }, { 0x30, X86_INS_XOR } };
+			for ( auto [base, id] : alu )
+			{
+				t[ base + 0 ] = { opcode_form::rm_reg, imm_kind::none, id, nullptr, true, ac_rw };
+				t[ base + 1 ] = { opcode_form::rm_reg, imm_kind::none, id, nullptr, false, ac_rw };
+				t[ base + 2 ] = { opcode_form::reg_rm, imm_kind::none, id, nullptr, true, ac_rw };
+				t[ base + 3 ] = { opcode_form::reg_rm, imm_kind::none, id, nullptr, false, ac_rw };
+				t[ base + 4 ] = { opcode_form::acc_imm, imm_kind::ib, id, nullptr, true, ac_rw };
+				t[ base + 5 ] = { opcode_form::acc_imm, imm_kind::iz, id, nullptr, false, ac_rw };
+			}
+			t[ 0x80 ] = { opcode_form::rm_imm, imm_kind::ib, X86_INS_INVALID, alu_group, true, ac_rw };
+			t[ 0x81 ] = { opcode_form::rm_imm, imm_kind::iz, X86_INS_INVALID, alu_group, false, ac_rw };
+			t[ 0x83 ] = { opcode_form::rm_imm, imm_kind::ib, X86_INS_INVALID, alu_group, false, ac_rw };
+			t[ 0xC0 ] = { opcode_form::rm_imm, imm_kind::count, X86_INS_INVALID, shift_group, true, ac_rw };
+			t[ 0xC1 ] = { opcode_form::rm_imm, imm_kind::count, X86_INS_INVALID, shift_group, false, ac_rw };
+			t[ 0xD2 ] = { opcode_form::rm_cl, imm_kind::none, X86_INS_INVALID, shift_group, true, ac_rw };
+			t[ 0xD3 ] = { opcode_form::rm_cl, imm_kind::none, X86_INS_INVALID, shift_group, false, ac_rw };
+
+			t[ 0x88 ] = { opcode_form::rm_reg, imm_kind::none, X86_INS_MOV, nullptr, true, ac_w };
+			t[ 0x89 ] = { opcode_form::rm_reg, imm_kind::none, X86_INS_MOV, nullptr, false, ac_w };
+			t[ 0x8A ] = { opcode_form::reg_rm, imm_kind::none, X86_INS_MOV, nullptr, true, ac_w };
+			t[ 0x8B ] = { opcode_form::reg_rm, imm_kind::none, X86_INS_MOV, nullptr, false, ac_w };
+			t[ 0xC6 ] = { opcode_form::rm_imm, imm_kind::ib, X86_INS_INVALID, mov_group, true, ac_w };
+			t[ 0xC7 ] = { opcode_form::rm_imm, imm_kind::iz, X86_INS_INVALID, mov_group, false, ac_w };
+			for ( uint8_t r = 0; r != 8; r++ )
+			{
+				t[ 0xB0 + r ] = { opcode_form::reg_imm, imm_kind::ib, X86_INS_MOV, nullptr, true, ac_w };
+				t[ 0xB8 + r ] = { opcode_form::reg_imm, imm_kind::iz, X86_INS_MOV, nullptr, false, ac_w };
+				t[ 0x50 + r ] = { opcode_form::stack_reg, imm_kind::none, X86_INS_PUSH, nullptr, false, ac_r };
+				t[ 0x58 + r ] = { opcode_form::stack_reg, imm_kind::none, X86_INS_POP, nullptr, false, ac_w };
+			}
+			t[ 0x8D ] = { opcode_form::lea, imm_kind::none, X86_INS_LEA, nullptr, false, ac_w };
+
+			for ( uint8_t cc = 0; cc != 16; cc++ )
+				t[ 0x70 + cc ] = { opcode_form::relative, imm_kind::rel8, jcc_table[ cc ] };
+			t[ 0xEB ] = { opcode_form::relative, imm_kind::rel8, X86_INS_JMP };
+			t[ 0xE9 ] = { opcode_form::relative, imm_kind::rel32, X86_INS_JMP };
+			t[ 0xE8 ] = { opcode_form::relative, imm_kind::rel32, X86_INS_CALL };
+			t[ 0xC3 ] = { opcode_form::ret, imm_kind::none, X86_INS_RET };
+			t[ 0xC2 ] = { opcode_form::ret, imm_kind::iw, X86_INS_RET };
+			return t;
+		}();
+		static constexpr std::array<opcode_entry, 256> two_byte_table = [ ] ()
+		{
+			std::array<opcode_entry, 256> t = {};
+			for ( uint8_t cc = 0; cc != 16; cc++ )
+				t[ 0x80 + cc ] = { opcode_form::relative, imm_kind::rel32, jcc_table[ cc ] };
+			t[ 0xB6 ] = { opcode_form::movzx, imm_kind::none, X86_INS_MOVZX, nullptr, true, ac_w };
+			t[ 0xB7 ] = { opcode_form::movzx, imm_kind::none, X86_INS_MOVZX, nullptr, false, ac_w };
+			return t;
+		}();
+
+		// Returns the general purpose register of the given index and size.
+		//
+		static x86_reg gpr( uint8_t index, uint8_t size, bool has_rex )
+		{
+			static constexpr x86_reg r64[ 16 ] = { 
+				X86_REG_RAX, X86_REG_RCX, X86_REG_RDX, X86_REG_RBX, X86_REG_RSP, X86_REG_RBP, X86_REG_RSI, X86_REG_RDI,
+				X86_REG_R8, X86_REG_R9, X86_REG_R10, X86_REG_R11, X86_REG_R12, X86_REG_R13, X86_REG_R14, X86_REG_R15
+			};
+			static constexpr x86_reg r32[ 16 ] = { 
+				X86_REG_EAX, X86_REG_ECX, X86_REG_EDX, X86_REG_EBX, X86_REG_ESP, X86_REG_EBP, X86_REG_ESI, X86_REG_EDI,
+				X86_REG_R8D, X86_REG_R9D, X86_REG_R10D, X86_REG_R11D, X86_REG_R12D, X86_REG_R13D, X86_REG_R14D, X86_REG_R15D
+			};
+			static constexpr x86_reg r16[ 16 ] = { 
+				X86_REG_AX, X86_REG_CX, X86_REG_DX, X86_REG_BX, X86_REG_SP, X86_REG_BP, X86_REG_SI, X86_REG_DI,
+				X86_REG_R8W, X86_REG_R9W, X86_REG_R10W, X86_REG_R11W, X86_REG_R12W, X86_REG_R13W, X86_REG_R14W, X86_REG_R15W
+			};
+			static constexpr x86_reg r8[ 16 ] = { 
+				X86_REG_AL, X86_REG_CL, X86_REG_DL, X86_REG_BL, X86_REG_SPL, X86_REG_BPL, X86_REG_SIL, X86_REG_DIL,
+				X86_REG_R8B, X86_REG_R9B, X86_REG_R10B, X86_REG_R11B, X86_REG_R12B, X86_REG_R13B, X86_REG_R14B, X86_REG_R15B
+			};
+			static constexpr x86_reg r8_legacy[ 4 ] = { X86_REG_AH, X86_REG_CH, X86_REG_DH, X86_REG_BH };
+
+			switch ( size )
+			{
+				case 8: return r64[ index ];
+				case 4: return r32[ index ];
+				case 2: return r16[ index ];
+				default: return ( !has_rex && index >= 4 && index < 8 ) ? r8_legacy[ index - 4 ] : r8[ index ];
+			}
+		}
+
+		// Flags Capstone reports for each instruction handled, instructions not listed
+		// do not touch the flags.
+		//
+		static constexpr uint64_t arith_flags = 
+			X86_EFLAGS_MODIFY_AF | X86_EFLAGS_MODIFY_CF | X86_EFLAGS_MODIFY_SF | X86_EFLAGS_MODIFY_ZF | X86_EFLAGS_MODIFY_PF | X86_EFLAGS_MODIFY_OF;
+		static constexpr uint64_t logic_flags = 
+			X86_EFLAGS_RESET_OF | X86_EFLAGS_RESET_CF | X86_EFLAGS_MODIFY_SF | X86_EFLAGS_MODIFY_ZF | X86_EFLAGS_MODIFY_PF | X86_EFLAGS_UNDEFINED_AF;
+		static constexpr uint64_t shift_flags = 
+			X86_EFLAGS_MODIFY_CF | X86_EFLAGS_MODIFY_SF | X86_EFLAGS_MODIFY_ZF | X86_EFLAGS_MODIFY_PF | X86_EFLAGS_MODIFY_OF | X86_EFLAGS_UNDEFINED_AF;
+		static constexpr std::pair<x86_insn, uint64_t> eflags_table[] = {
+			{ X86_INS_ADD, arith_flags }, { X86_INS_SUB, arith_flags },
+			{ X86_INS_AND, logic_flags }, { X86_INS_OR, logic_flags }, { X86_INS_XOR, logic_flags },
+			{ X86_INS_SHL, shift_flags }, { X86_INS_SHR, shift_flags },
+			{ X86_INS_JO, X86_EFLAGS_TEST_OF }, { X86_INS_JNO, X86_EFLAGS_TEST_OF },
+			{ X86_INS_JB, X86_EFLAGS_TEST_CF }, { X86_INS_JAE, X86_EFLAGS_TEST_CF },
+			{ X86_INS_JE, X86_EFLAGS_TEST_ZF }, { X86_INS_JNE, X86_EFLAGS_TEST_ZF },
+			{ X86_INS_JBE, X86_EFLAGS_TEST_CF | X86_EFLAGS_TEST_ZF }, { X86_INS_JA, X86_EFLAGS_TEST_CF | X86_EFLAGS_TEST_ZF },
+			{ X86_INS_JS, X86_EFLAGS_TEST_SF }, { X86_INS_JNS, X86_EFLAGS_TEST_SF },
+			{ X86_INS_JP, X86_EFLAGS_TEST_PF }, { X86_INS_JNP, X86_EFLAGS_TEST_PF },
+			{ X86_INS_JL, X86_EFLAGS_TEST_SF | X86_EFLAGS_TEST_OF }, { X86_INS_JGE, X86_EFLAGS_TEST_SF | X86_EFLAGS_TEST_OF },
+			{ X86_INS_JLE, X86_EFLAGS_TEST_ZF | X86_EFLAGS_TEST_SF | X86_EFLAGS_TEST_OF }, { X86_INS_JG, X86_EFLAGS_TEST_ZF | X86_EFLAGS_TEST_SF | X86_EFLAGS_TEST_OF },
+		};
+
+		// Returns the flags of the given identifier.
+		//
+		static uint64_t eflags_of( uint32_t id )
+		{
+			static const auto table = [ ] ()
+			{
+				std::array<uint64_t, X86_INS_ENDING> t = {};
+				for ( auto [id, flags] : eflags_table )
+					t[ id ] = flags;
+				return t;
+			}();
+			return table[ id ];
+		}
+
+		// Returns the interned mnemonic of the given identifier.
+		//
+		static interned_string mnemonic_of( uint32_t id )
+		{
+			static const auto table = [ ] ()
+			{
+				std::array<interned_string, X86_INS_ENDING> t = {};
+				constexpr std::pair<x86_insn, const char*> names[] = {
+					{ X86_INS_ADD, "add" }, { X86_INS_OR, "or" }, { X86_INS_AND, "and" }, { X86_INS_SUB, "sub" }, { X86_INS_XOR, "xor" },
+					{ X86_INS_SHL, "shl" }, { X86_INS_SHR, "shr" }, { X86_INS_MOV, "mov" }, { X86_INS_MOVZX, "movzx" }, { X86_INS_LEA, "lea" },
+					{ X86_INS_PUSH, "push" }, { X86_INS_POP, "pop" }, { X86_INS_JMP, "jmp" }, { X86_INS_CALL, "call" }, { X86_INS_RET, "ret" },
+					{ X86_INS_JO, "jo" }, { X86_INS_JNO, "jno" }, { X86_INS_JB, "jb" }, { X86_INS_JAE, "jae" },
+					{ X86_INS_JE, "je" }, { X86_INS_JNE, "jne" }, { X86_INS_JBE, "jbe" }, { X86_INS_JA, "ja" },
+					{ X86_INS_JS, "js" }, { X86_INS_JNS, "jns" }, { X86_INS_JP, "jp" }, { X86_INS_JNP, "jnp" },
+					{ X86_INS_JL, "jl" }, { X86_INS_JGE, "jge" }, { X86_INS_JLE, "jle" }, { X86_INS_JG, "jg" },
+				};
+				for ( auto [id, name] : names )
+					t[ id ] = intern( name );
+				return t;
+			}();
+			return table[ id ];
+		}
+
+		// State of the instruction being decoded.
+		//
+		struct decoder
+		{
+			compact_instruction& out;
+			const uint8_t* bytes;
+			size_t limit;
+			size_t pos = 0;
+
+			bool has( size_t n ) const { return pos + n <= limit; }
+
+			// Reads a sign-extended value of the given size.
+			//
+			bool read( int64_t& value, size_t n )
+			{
+				if ( !has( n ) ) return false;
+				switch ( n )
+				{
+					case 1: value = ( int8_t ) bytes[ pos ]; break;
+					case 2: { int16_t v; memcpy( &v, bytes + pos, 2 ); value = v; break; }
+					case 4: { int32_t v; memcpy( &v, bytes + pos, 4 ); value = v; break; }
+					default: return false;
+				}
+				pos += n;
+				return true;
+			}
+
+			// Reads the immediate into the operand, sets the encoding details.
+			//
+			bool read_imm( cs_x86_op& op, size_t n, uint8_t size )
+			{
+				out.encoding.imm_offset = ( uint8_t ) pos;
+				out.encoding.imm_size = ( uint8_t ) n;
+				op.type = X86_OP_IMM;
+				op.size = size;
+				if ( !read( op.imm, n ) )
+					return false;
+				if ( size < 8 )
+					op.imm &= ( 1ll << ( size * 8 ) ) - 1;
+				return true;
+			}
+
+			// Reads the ModRM byte and everything following it up to the immediate, sets the
+			// register operand if non-null and the r/m operand.
+			//
+			bool read_modrm( cs_x86_op* reg, uint8_t reg_size, cs_x86_op& rm, uint8_t rm_size, bool memory_only = false )
+			{
+				if ( !has( 1 ) ) return false;
+				uint8_t rex = out.rex;
+				out.encoding.modrm_offset = ( uint8_t ) pos;
+				uint8_t modrm = out.modrm = bytes[ pos++ ];
+				uint8_t mod = modrm >> 6;
+				uint8_t rm_index = ( modrm & 7 ) | ( ( rex & 1 ) << 3 );
+
+				if ( reg )
+				{
+					reg->type = X86_OP_REG;
+					reg->reg = gpr( ( ( modrm >> 3 ) & 7 ) | ( ( rex & 4 ) << 1 ), reg_size, rex != 0 );
+					reg->size = reg_size;
+				}
+
+				// Register operand.
+				//
+				if ( mod == 3 )
+				{
+					if ( memory_only ) return false;
+					rm.type = X86_OP_REG;
+					rm.reg = gpr( rm_index, rm_size, rex != 0 );
+					rm.size = rm_size;
+					return true;
+				}
+
+				// Memory operand, resolve the base and index.
+				//
+				rm.type = X86_OP_MEM;
+				rm.size = rm_size;
+				rm.mem.segment = X86_REG_INVALID;
+				rm.mem.index = X86_REG_INVALID;
+				rm.mem.scale = 1;
+				size_t disp_size = mod == 1 ? 1 : mod == 2 ? 4 : 0;
+
+				if ( ( modrm & 7 ) == 4 )
+				{
+					if ( !has( 1 ) ) return false;
+					uint8_t sib = out.sib = bytes[ pos++ ];
+					uint8_t index = ( ( sib >> 3 ) & 7 ) | ( ( rex & 2 ) << 2 );
+					uint8_t base = ( sib & 7 ) | ( ( rex & 1 ) << 3 );
+					out.sib_scale = ( int8_t ) ( 1 << ( sib >> 6 ) );
+
+					// Scaled index without a register is printed as riz, leave it to Capstone.
+					//
+					if ( index != 4 )
+					{
+						rm.mem.index = out.sib_index = gpr( index, 8, true );
+						rm.mem.scale = out.sib_scale;
+					}
+					else if ( out.sib_scale != 1 )
+					{
+						return false;
+					}
+					if ( ( sib & 7 ) == 5 && mod == 0 )
+					{
+						rm.mem.base = X86_REG_INVALID;
+						disp_size = 4;
+					}
+					else
+					{
+						rm.mem.base = out.sib_base = gpr( base, 8, true );
+					}
+				}
+				else if ( ( modrm & 7 ) == 5 && mod == 0 )
+				{
+					rm.mem.base = X86_REG_RIP;
+					disp_size = 4;
+				}
+				else
+				{
+					rm.mem.base = gpr( rm_index, 8, true );
+				}
+
+				rm.mem.disp = 0;
+				if ( disp_size )
+				{
+					out.encoding.disp_offset = ( uint8_t ) pos;
+					out.encoding.disp_size = ( uint8_t ) disp_size;
+					if ( !read( rm.mem.disp, disp_size ) )
+						return false;
+					out.disp = rm.mem.disp;
+				}
+				return true;
+			}
+		};
+	};
+
+	// Decodes the instruction at the given address into [out] if it is handled natively,
+	// returns false otherwise in which case [out] is left in an unspecified state.
+	//
+	bool fast_decode( compact_instruction& out, const void* bytes, uint64_t address, size_t size )
+	{
+		using namespace impl;
+
+		out = {};
+		out.address = address;
+		out.addr_size = 8;
+		decoder d{ out, ( const uint8_t* ) bytes, std::min<size_t>( size, 15 ) };
+
+		// Only the operand size override and REX prefixes are accepted, the rest are left to Capstone.
+		//
+		bool opsize = false;
+		if ( d.has( 1 ) && d.bytes[ d.pos ] == 0x66 )
+		{
+			out.prefix[ 2 ] = 0x66;
+			opsize = true;
+			d.pos++;
+		}
+		if ( d.has( 1 ) && ( d.bytes[ d.pos ] & 0xF0 ) == 0x40 )
+			out.rex = d.bytes[ d.pos++ ];
+		bool rex_w = out.rex & 8;
+
+		// Look up the opcode.
+		//
+		if ( !d.has( 1 ) ) return false;
+		uint8_t op = d.bytes[ d.pos++ ];
+		const opcode_entry* entry = &one_byte_table[ op ];
+		out.opcode[ 0 ] = op;
+		out.opcode_length = 1;
+		if ( op == 0x0F )
+		{
+			if ( !d.has( 1 ) ) return false;
+			op = d.bytes[ d.pos++ ];
+			entry = &two_byte_table[ op ];
+			out.opcode[ 1 ] = op;
+			out.opcode_length = 2;
+		}
+		if ( entry->form == opcode_form::none )
+			return false;
+
+		uint8_t op_size = entry->byte_sized ? 1 : rex_w ? 8 : opsize ? 2 : 4;
+		size_t iz_size = op_size == 2 ? 2 : 4;
+		cs_x86_op* ops = out.operands;
+		x86_insn id = entry->id;
+
+		switch ( entry->form )
+		{
+			case opcode_form::rm_reg:
+				if ( !d.read_modrm( &ops[ 1 ], op_size, ops[ 0 ], op_size ) ) return false;
+				out.operand_count = 2;
+				break;
+			case opcode_form::reg_rm:
+				if ( !d.read_modrm( &ops[ 0 ], op_size, ops[ 1 ], op_size ) ) return false;
+				out.operand_count = 2;
+				break;
+			case opcode_form::lea:
+				if ( opsize ) return false;
+				if ( !d.read_modrm( &ops[ 0 ], op_size, ops[ 1 ], op_size, true ) ) return false;
+				out.operand_count = 2;
+				break;
+			case opcode_form::movzx:
+				if ( opsize && !entry->byte_sized ) return false;
+				op_size = rex_w ? 8 : opsize ? 2 : 4;
+				if ( !d.read_modrm( &ops[ 0 ], op_size, ops[ 1 ], entry->byte_sized ? 1 : 2 ) ) return false;
+				out.operand_count = 2;
+				break;
+			case opcode_form::acc_imm:
+				ops[ 0 ].type = X86_OP_REG;
+				ops[ 0 ].reg = gpr( 0, op_size, false );
+				ops[ 0 ].size = op_size;
+				if ( !d.read_imm( ops[ 1 ], entry->imm == imm_kind::ib ? 1 : iz_size, op_size ) ) return false;
+				out.operand_count = 2;
+				break;
+			case opcode_form::rm_imm:
+			case opcode_form::rm_cl:
+				if ( !d.has( 1 ) ) return false;
+				id = entry->group[ ( d.bytes[ d.pos ] >> 3 ) & 7 ];
+				if ( id == X86_INS_INVALID ) return false;
+				if ( !d.read_modrm( nullptr, 0, ops[ 0 ], op_size ) ) return false;
+				if ( entry->form == opcode_form::rm_cl )
+				{
+					ops[ 1 ].type = X86_OP_REG;
+					ops[ 1 ].reg = X86_REG_CL;
+					ops[ 1 ].size = 1;
+					ops[ 1 ].access = ac_r;
+				}
+				else if ( entry->imm == imm_kind::count )
+				{
+					if ( !d.read_imm( ops[ 1 ], 1, 1 ) ) return false;
+				}
+				else
+				{
+					if ( !d.read_imm( ops[ 1 ], entry->imm == imm_kind::ib ? 1 : iz_size, op_size ) ) return false;
+				}
+				out.operand_count = 2;
+				break;
+			case opcode_form::reg_imm:
+				// REX.W form with a 64-bit immediate is movabs.
+				//
+				if ( rex_w && !entry->byte_sized ) return false;
+				ops[ 0 ].type = X86_OP_REG;
+				ops[ 0 ].reg = gpr( ( op & 7 ) | ( ( out.rex & 1 ) << 3 ), op_size, out.rex != 0 );
+				ops[ 0 ].size = op_size;
+				if ( !d.read_imm( ops[ 1 ], entry->imm == imm_kind::ib ? 1 : iz_size, op_size ) ) return false;
+				out.operand_count = 2;
+				break;
+			case opcode_form::stack_reg:
+				if ( opsize ) return false;
+				ops[ 0 ].type = X86_OP_REG;
+				ops[ 0 ].reg = gpr( ( op & 7 ) | ( ( out.rex & 1 ) << 3 ), 8, true );
+				ops[ 0 ].size = 8;
+				out.operand_count = 1;
+				out.regs_read.set( X86_REG_RSP );
+				out.regs_write.set( X86_REG_RSP );
+				out.groups.set( X86_GRP_MODE64 );
+				break;
+			case opcode_form::relative:
+			{
+				if ( opsize ) return false;
+				int64_t rel;
+				size_t n = entry->imm == imm_kind::rel8 ? 1 : 4;
+				out.encoding.imm_offset = ( uint8_t ) d.pos;
+				out.encoding.imm_size = ( uint8_t ) n;
+				if ( !d.read( rel, n ) ) return false;
+				ops[ 0 ].type = X86_OP_IMM;
+				ops[ 0 ].imm = ( int64_t ) ( address + d.pos + rel );
+				ops[ 0 ].size = 8;
+				out.operand_count = 1;
+
+				if ( id == X86_INS_CALL )
+				{
+					out.regs_read.set( X86_REG_RSP );
+					out.regs_read.set( X86_REG_RIP );
+					out.regs_write.set( X86_REG_RSP );
+					out.groups.set( X86_GRP_CALL );
+					out.groups.set( X86_GRP_MODE64 );
+				}
+				else
+				{
+					if ( id != X86_INS_JMP )
+						out.regs_read.set( X86_REG_EFLAGS );
+					out.groups.set( X86_GRP_JUMP );
+				}
+				out.groups.set( X86_GRP_BRANCH_RELATIVE );
+				break;
+			}
+			case opcode_form::ret:
+				if ( opsize ) return false;
+				if ( entry->imm == imm_kind::iw )
+				{
+					if ( !d.read_imm( ops[ 0 ], 2, 2 ) ) return false;
+					out.operand_count = 1;
+				}
+				out.regs_read.set( X86_REG_RSP );
+				out.regs_write.set( X86_REG_RSP );
+				out.groups.set( X86_GRP_RET );
+				out.groups.set( X86_GRP_MODE64 );
+				break;
+			default:
+				return false;
+		}
+
+		// Set the access of the operands, first operand uses the access in the table and
+		// the rest are read if not immediates.
+		//
+		if ( out.operand_count && ops[ 0 ].type != X86_OP_IMM )
+			ops[ 0 ].access = entry->access;
+		for ( size_t i = 1; i < out.operand_count; i++ )
+			if ( ops[ i ].type != X86_OP_IMM )
+				ops[ i ].access = ac_r;
+
+		// Arithmetic and shifts write the flags.
+		//
+		if ( id != X86_INS_MOV && id != X86_INS_MOVZX && id != X86_INS_LEA && entry->form != opcode_form::stack_reg && 
+			 entry->form != opcode_form::relative && entry->form != opcode_form::ret )
+			out.regs_write.set( X86_REG_EFLAGS );
+
+		// Copy the bytes, the identifier and the flags.
+		//
+		out.id = id;
+		out.eflags = eflags_of( id );
+		out.length = ( uint8_t ) d.pos;
+		memcpy( out.bytes, bytes, out.length );
+		out.mnemonic = mnemonic_of( id );
+		return true;
+	}
+
+	// Whether or not the native decoder is used by decode_compact.
+	//
+	static std::atomic<bool> fast_decoding = false;
+
+	// Enables or disables the native decoder used by decode_compact and disasm_fast.
+	//
+	void set_fast_decoding( bool enable )
+	{
+		fast_decoding.store( enable, std::memory_order_relaxed );
+	}
+	bool is_fast_decoding()
+	{
+		return fast_decoding.load( std::memory_order_relaxed );
+	}
+
+	// Decodes the instruction natively if enabled and possible, falls back to Capstone otherwise,
+	// returns false if the bytes cannot be decoded.
+	//
+	bool decode_compact( compact_instruction& out, const void* bytes, uint64_t address, size_t size )
+	{
+		if ( is_fast_decoding() && fast_decode( out, bytes, address, size ) )
+			return true;
+		return capstone::disasm_stream( bytes, address, std::min<size_t>( size, 15 ), [ & ] ( const cs_insn& in )
+		{
+			out.assign( in );
+		}, 1 ) != 0;
+	}
+
+	// Disassembles into compact records appended to [out] using the fast path if enabled,
+	// same semantics as capstone::disasm_compact.
+	//
+	size_t disasm_fast( std::vector<compact_instruction>& out, const void* bytes, uint64_t address, size_t size, size_t count )
+	{
+		const uint8_t* it = ( const uint8_t* ) bytes;
+		size_t left = size ? size : -1;
+		if ( size ) count = 0;
+
+		size_t n = 0;
+		while ( left && ( !count || n != count ) )
+		{
+			compact_instruction& ins = out.emplace_back();
+			if ( !decode_compact( ins, it, address, std::min<size_t>( left, 15 ) ) )
+			{
+				out.pop_back();
+				break;
+			}
+			it += ins.length;
+			address += ins.length;
+			left -= ins.length;
+			n++;
+		}
+		return n;
+	}
+
+	// Decodes [samples] randomly generated encodings of the handled instructions with both the 
+	// native decoder and Capstone and compares the results, the first [max_details] mismatches 
+	// are described in the report.
+	//
+	fast_decoder_report verify_fast_decoder( size_t samples, uint64_t seed, size_t max_details )
+	{
+		static constexpr uint8_t opcodes[] = {
+			0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25,
+			0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x50, 0x53, 0x55, 0x57, 0x58, 0x5B,
+			0x5D, 0x5F, 0x70, 0x74, 0x75, 0x7F, 0x80, 0x81, 0x83, 0x88, 0x89, 0x8A, 0x8B, 0x8D, 0xB0, 0xB4, 0xB8, 0xBF,
+			0xC0, 0xC1, 0xC2, 0xC3, 0xC6, 0xC7, 0xD2, 0xD3, 0xE8, 0xE9, 0xEB, 0x0F
+		};
+		static constexpr uint8_t two_byte_opcodes[] = { 0x80, 0x84, 0x85, 0x8F, 0xB6, 0xB7 };
+
+		fast_decoder_report report;
+		std::mt19937_64 rng{ seed };
+		auto describe = [ & ] ( const uint8_t* bytes, const char* field )
+		{
+			report.mismatches++;
+			if ( report.details.size() < max_details )
+			{
+				std::string hex;
+				for ( size_t i = 0; i != 15; i++ )
+					hex += format::str( "%02x", bytes[ i ] );
+				report.details.push_back( format::str( "%s: %s", hex, field ) );
+			}
+		};
+
+		compact_instruction fast, reference;
+		for ( size_t n = 0; n != samples; n++ )
+		{
+			// Generate the encoding, with random prefixes and trailing bytes.
+			//
+			uint8_t bytes[ 15 ];
+			for ( uint8_t& b : bytes )
+				b = ( uint8_t ) rng();
+			size_t pos = 0;
+			if ( !( rng() % 8 ) ) bytes[ pos++ ] = 0x66;
+			if ( rng() % 2 ) bytes[ pos++ ] = 0x40 | ( rng() % 16 );
+			bytes[ pos ] = opcodes[ rng() % std::size( opcodes ) ];
+			if ( bytes[ pos ] == 0x0F )
+				bytes[ pos + 1 ] = two_byte_opcodes[ rng() % std::size( two_byte_opcodes ) ];
+			uint64_t address = rng() & 0x7FFFFFFFFFFF;
+
+			report.samples++;
+			if ( !fast_decode( fast, bytes, address, sizeof( bytes ) ) )
+				continue;
+			report.decoded++;
+
+			if ( !capstone::disasm_stream( bytes, address, sizeof( bytes ), [ & ] ( const cs_insn& in ) { reference.assign( in ); }, 1 ) )
+			{
+				describe( bytes, "rejected by Capstone" );
+				continue;
+			}
+
+			// Compare the fields the fast path produces.
+			//
+			if ( fast.id != reference.id ) describe( bytes, "id" );
+			else if ( fast.length != reference.length ) describe( bytes, "length" );
+			else if ( fast.mnemonic != reference.mnemonic ) describe( bytes, "mnemonic" );
+			else if ( fast.operand_count != reference.operand_count ) describe( bytes, "operand count" );
+			else if ( memcmp( fast.prefix, reference.prefix, sizeof( fast.prefix ) ) || memcmp( fast.opcode, reference.opcode, sizeof( fast.opcode ) ) ||
+					  fast.rex != reference.rex || fast.modrm != reference.modrm || fast.sib != reference.sib || fast.disp != reference.disp )
+				describe( bytes, "encoding" );
+			else if ( memcmp( &fast.encoding, &reference.encoding, sizeof( cs_x86_encoding ) ) )
+				describe( bytes, "encoding offsets" );
+			else if ( fast.regs_read != reference.regs_read || fast.regs_write != reference.regs_write )
+				describe( bytes, "implicit registers" );
+			else if ( fast.groups != reference.groups )
+				describe( bytes, "groups" );
+			else if ( fast.eflags != reference.eflags )
+				describe( bytes, "eflags" );
+			else
+			{
+				for ( size_t i = 0; i != fast.operand_count; i++ )
+				{
+					const cs_x86_op& a = fast.operands[ i ];
+					const cs_x86_op& b = reference.operands[ i ];
+					bool equal = a.type == b.type && a.size == b.size && a.access == b.access;
+					if ( equal && a.type == X86_OP_REG ) equal = a.reg == b.reg;
+					if ( equal && a.type == X86_OP_IMM ) equal = a.imm == b.imm;
+					if ( equal && a.type == X86_OP_MEM ) 
+						equal = a.mem.segment == b.mem.segment && a.mem.base == b.mem.base && a.mem.index == b.mem.index && 
+								a.mem.scale == b.mem.scale && a.mem.disp == b.mem.disp;
+					if ( !equal )
+					{
+						describe( bytes, "operands" );
+						break;
+					}
+				}
+			}
+		}
+		return report;
+	}
+};
\ No newline at end of file
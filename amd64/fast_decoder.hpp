@@ -0,0 +1,92 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+
+// Furthermore, the following pieces of software have additional copyrights
+// licenses, and/or restrictions:
+//
+// |--------------------------------------------------------------------------|
+// | File name               | Link for further information                   |
+// |-------------------------|------------------------------------------------|
+// | amd64/*                 | https://github.com/aquynh/capstone/            |
+// |                         | https://github.com/keystone-engine/keystone/   |
+// |--------------------------------------------------------------------------|
+//
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "compact_instruction.hpp"
+
+// Native decoder for the most common encodings (mov, lea, push, pop, add, sub, xor, and, 
+// or, shl, shr, jmp, jcc, call, ret and movzx) that fills compact records directly from
+// a table instead of invoking Capstone, anything else is left to Capstone.
+// - Explicit operands, encoding details, identifiers, implicit registers, groups and eflags
+//   are produced the way Capstone would, so records do not depend on the path decoding them.
+// - The fast path is opt-in: until it is enabled every instruction is decoded by Capstone,
+//   it should only be enabled once verify_fast_decoder reports no mismatches against the
+//   Capstone build in use.
+//
+namespace vtil::amd64
+{
+	// Enables or disables the native decoder used by decode_compact and disasm_fast, 
+	// disabled by default.
+	//
+	void set_fast_decoding( bool enable );
+	bool is_fast_decoding();
+
+	// Decodes the instruction at the given address into [out] if it is handled natively,
+	// returns false otherwise in which case [out] is left in an unspecified state.
+	//
+	bool fast_decode( compact_instruction& out, const void* bytes, uint64_t address, size_t size = 15 );
+
+	// Decodes the instruction natively if enabled and possible, falls back to Capstone otherwise,
+	// returns false if the bytes cannot be decoded.
+	//
+	bool decode_compact( compact_instruction& out, const void* bytes, uint64_t address, size_t size = 15 );
+
+	// Disassembles into compact records appended to [out] using the fast path if enabled,
+	// same semantics as capstone::disasm_compact.
+	//
+	size_t disasm_fast( std::vector<compact_instruction>& out, const void* bytes, uint64_t address, size_t size = 0, size_t count = 1 );
+
+	// Result of the differential verification.
+	//
+	struct fast_decoder_report
+	{
+		size_t samples = 0;
+		size_t decoded = 0;
+		size_t mismatches = 0;
+		std::vector<std::string> details;
+	};
+
+	// Decodes [samples] randomly generated encodings of the handled instructions with both the 
+	// native decoder and Capstone and compares the results, the first [max_details] mismatches 
+	// are described in the report.
+	//
+	fast_decoder_report verify_fast_decoder( size_t samples = 1000000, uint64_t seed = 0, size_t max_details = 16 );
+};
\ No newline at end of file
@@ -0,0 +1,210 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+
+// Furthermore, the following pieces of software have additional copyrights
+// licenses, and/or restrictions:
+//
+// |--------------------------------------------------------------------------|
+// | File name               | Link for further information                   |
+// |-------------------------|------------------------------------------------|
+// | amd64/*                 | https://github.com/aquynh/capstone/            |
+// |                         | https://github.com/keystone-engine/keystone/   |
+// |--------------------------------------------------------------------------|
+//
+#pragma once
+#include <stdint.h>
+#include <bit>
+#include <iterator>
+#include <initializer_list>
+#include <intrin.h>
+#include <capstone/capstone.h>
+#include "..\io\asserts.hpp"
+
+namespace vtil::amd64
+{
+	// Fixed-size set of identifiers (e.g. registers or groups) below [N] stored as a bitmask,
+	// enumerated as values of type T. Provides the commonly used parts of the std::set interface
+	// so that it can be used in its place, set operations process a vector at a time.
+	//
+	template<size_t N, typename T = uint16_t>
+	struct id_mask
+	{
+		static constexpr size_t word_count = ( N + 63 ) / 64;
+		uint64_t words[ word_count ] = {};
+
+		// Iterator over the identifiers in the set in ascending order.
+		//
+		struct iterator
+		{
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = T;
+			using difference_type = ptrdiff_t;
+			using pointer = const T*;
+			using reference = T;
+
+			const uint64_t* words = nullptr;
+			size_t index = word_count;
+			uint64_t pending = 0;
+
+			iterator() = default;
+			iterator( const uint64_t* words, size_t index ) : words( words ), index( index ), pending( index < word_count ? words[ index ] : 0 ) { skip(); }
+
+			// Moves to the next word with bits set if the current one is consumed.
+			//
+			void skip() { while ( !pending && ++index < word_count ) pending = words[ index ]; if ( index > word_count ) index = word_count; }
+
+			T operator*() const { return T( index * 64 + std::countr_zero( pending ) ); }
+			iterator& operator++() { pending &= pending - 1; skip(); return *this; }
+			iterator operator++( int ) { iterator it = *this; ++*this; return it; }
+			bool operator==( const iterator& o ) const { return index == o.index && pending == o.pending; }
+			bool operator!=( const iterator& o ) const { return !operator==( o ); }
+		};
+		using value_type = T;
+		using const_iterator = iterator;
+
+		// Constructed from a list or a range of identifiers.
+		//
+		id_mask() = default;
+		id_mask( std::initializer_list<T> ids ) { for ( T id : ids ) set( id ); }
+		template<std::input_iterator It>
+		id_mask( It first, It last ) { for ( ; first != last; ++first ) set( *first ); }
+
+		// Basic bit operations, identifiers out of range cannot be stored and are
+		// never contained so resetting them is a no-op.
+		//
+		void set( size_t id ) { fcheck( id < N ); words[ id / 64 ] |= 1ull << ( id % 64 ); }
+		void reset( size_t id ) { if ( id < N ) words[ id / 64 ] &= ~( 1ull << ( id % 64 ) ); }
+		bool test( size_t id ) const { return id < N && ( words[ id / 64 ] >> ( id % 64 ) ) & 1; }
+
+		// Set-like interface.
+		//
+		void insert( size_t id ) { set( id ); }
+		void erase( size_t id ) { reset( id ); }
+		bool contains( size_t id ) const { return test( id ); }
+		size_t count( size_t id ) const { return test( id ); }
+		void clear() { *this = {}; }
+		iterator begin() const { return { words, 0 }; }
+		iterator end() const { return { words, word_count }; }
+
+		// Returns the number of identifiers in the set.
+		//
+		size_t size() const
+		{
+			size_t n = 0;
+			for ( uint64_t word : words )
+				n += std::popcount( word );
+			return n;
+		}
+
+		// Checks whether the set is empty, shares any identifiers with or is a subset of another set.
+		//
+		bool empty() const
+		{
+			uint64_t acc = 0;
+			for ( uint64_t word : words )
+				acc |= word;
+			return !acc;
+		}
+		bool intersects( const id_mask& o ) const
+		{
+			uint64_t acc = 0;
+			for ( size_t i = 0; i != word_count; i++ )
+				acc |= words[ i ] & o.words[ i ];
+			return acc != 0;
+		}
+		bool is_subset_of( const id_mask& o ) const
+		{
+			uint64_t acc = 0;
+			for ( size_t i = 0; i != word_count; i++ )
+				acc |= words[ i ] & ~o.words[ i ];
+			return !acc;
+		}
+
+		// Set operations, union (|), intersection (&), difference (-) and symmetric difference (^).
+		//
+		id_mask& operator|=( const id_mask& o ) { apply<'|'>( words, words, o.words ); return *this; }
+		id_mask& operator&=( const id_mask& o ) { apply<'&'>( words, words, o.words ); return *this; }
+		id_mask& operator-=( const id_mask& o ) { apply<'-'>( words, words, o.words ); return *this; }
+		id_mask& operator^=( const id_mask& o ) { apply<'^'>( words, words, o.words ); return *this; }
+		id_mask operator|( const id_mask& o ) const { id_mask r; apply<'|'>( r.words, words, o.words ); return r; }
+		id_mask operator&( const id_mask& o ) const { id_mask r; apply<'&'>( r.words, words, o.words ); return r; }
+		id_mask operator-( const id_mask& o ) const { id_mask r; apply<'-'>( r.words, words, o.words ); return r; }
+		id_mask operator^( const id_mask& o ) const { id_mask r; apply<'^'>( r.words, words, o.words ); return r; }
+
+		bool operator==( const id_mask& o ) const
+		{
+			uint64_t acc = 0;
+			for ( size_t i = 0; i != word_count; i++ )
+				acc |= words[ i ] ^ o.words[ i ];
+			return !acc;
+		}
+		bool operator!=( const id_mask& o ) const { return !operator==( o ); }
+
+		// Applies the operation word by word, using AVX2 if enabled at compile-time and SSE2 otherwise.
+		//
+		template<char op>
+		__forceinline static void apply( uint64_t* out, const uint64_t* a, const uint64_t* b )
+		{
+			size_t i = 0;
+#if defined( __AVX2__ )
+			for ( ; ( i + 4 ) <= word_count; i += 4 )
+			{
+				__m256i x = _mm256_loadu_si256( ( const __m256i* ) ( a + i ) );
+				__m256i y = _mm256_loadu_si256( ( const __m256i* ) ( b + i ) );
+				if constexpr ( op == '|' )      x = _mm256_or_si256( x, y );
+				else if constexpr ( op == '&' ) x = _mm256_and_si256( x, y );
+				else if constexpr ( op == '-' ) x = _mm256_andnot_si256( y, x );
+				else                            x = _mm256_xor_si256( x, y );
+				_mm256_storeu_si256( ( __m256i* ) ( out + i ), x );
+			}
+#endif
+			for ( ; ( i + 2 ) <= word_count; i += 2 )
+			{
+				__m128i x = _mm_loadu_si128( ( const __m128i* ) ( a + i ) );
+				__m128i y = _mm_loadu_si128( ( const __m128i* ) ( b + i ) );
+				if constexpr ( op == '|' )      x = _mm_or_si128( x, y );
+				else if constexpr ( op == '&' ) x = _mm_and_si128( x, y );
+				else if constexpr ( op == '-' ) x = _mm_andnot_si128( y, x );
+				else                            x = _mm_xor_si128( x, y );
+				_mm_storeu_si128( ( __m128i* ) ( out + i ), x );
+			}
+			for ( ; i != word_count; i++ )
+			{
+				if constexpr ( op == '|' )      out[ i ] = a[ i ] | b[ i ];
+				else if constexpr ( op == '&' ) out[ i ] = a[ i ] & b[ i ];
+				else if constexpr ( op == '-' ) out[ i ] = a[ i ] & ~b[ i ];
+				else                            out[ i ] = a[ i ] ^ b[ i ];
+			}
+		}
+	};
+
+	// Sets of Capstone register and group identifiers, group identifiers are bytes.
+	//
+	using register_mask = id_mask<X86_REG_ENDING, uint16_t>;
+	using group_mask = id_mask<256, uint8_t>;
+};
\ No newline at end of file
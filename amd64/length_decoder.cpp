@@ -0,0 +1,413 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+
+// Furthermore, the following pieces of software have additional copyrights
+// licenses, and/or restrictions:
+//
+// |--------------------------------------------------------------------------|
+// | File name               | Link for further information                   |
+// |-------------------------|------------------------------------------------|
+// | amd64/*                 | https://github.com/aquynh/capstone/            |
+// |                         | https://github.com/keystone-engine/keystone/   |
+// |--------------------------------------------------------------------------|
+//
+#include "length_decoder.hpp"
+#include <array>
+#include <random>
+#include <algorithm>
+#include "disassembly.hpp"
+#include "..\io\formatting.hpp"
+
+namespace vtil::amd64
+{
+	namespace impl
+	{
+		// Description of each opcode packed into a byte, low nibble holds the immediate kind.
+		//
+		enum length_flags : uint8_t
+		{
+			imm_none =     0,
+			imm_b =        1,     // imm8
+			imm_w =        2,     // imm16
+			imm_z =        3,     // imm16 if the operand size is 16 bits, imm32 otherwise
+			imm_v =        4,     // imm16, imm32 or imm64 depending on the operand size
+			imm_moffs =    5,     // moffs64 or moffs32 with the address size override
+			imm_enter =    6,     // imm16 followed by imm8
+			imm_test_b =   7,     // imm8 if ModRM.reg is test
+			imm_test_z =   8,     // imm_z if ModRM.reg is test
+			imm_d =        9,     // imm32
+			imm_sse4a =    10,    // two imm8s if the SSE4a form is selected by the prefix and ModRM
+			imm_rel =      11,    // rel16 or rel32 of near branches, see the rule where it is skipped
+			imm_mask =     0x0F,
+
+			has_modrm =    0x10,
+			op_invalid =   0x20,
+			op_prefix =    0x40,
+			op_special =   0x80,  // REX, escape, VEX, EVEX or XOP
+		};
+
+		static constexpr uint8_t M = has_modrm;
+		static constexpr uint8_t X = op_invalid;
+		static constexpr uint8_t P = op_prefix;
+		static constexpr uint8_t S = op_special;
+
+		// One-byte opcode map in long mode.
+		//
+		static constexpr uint8_t one_byte_table[ 256 ] = {
+		//  0       1       2       3       4       5       6       7       8       9       A       B       C       D       E       F
+			M,      M,      M,      M,      imm_b,  imm_z,  X,      X,      M,      M,      M,      M,      imm_b,  imm_z,  X,      S,     // 0
+			M,      M,      M,      M,      imm_b,  imm_z,  X,      X,      M,      M,      M,      M,      imm_b,  imm_z,  X,      X,     // 1
+			M,      M,      M,      M,      imm_b,  imm_z,  P,      X,      M,      M,      M,      M,      imm_b,  imm_z,  P,      X,     // 2
+			M,      M,      M,      M,      imm_b,  imm_z,  P,      X,      M,      M,      M,      M,      imm_b,  imm_z,  P,      X,     // 3
+			S,      S,      S,      S,      S,      S,      S,      S,      S,      S,      S,      S,      S,      S,      S,      S,     // 4
+			0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,     // 5
+			X,      X,      S,      M,      P,      P,      P,      P,      imm_z,  M|imm_z,imm_b,  M|imm_b,0,      0,      0,      0,     // 6
+			imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b, // 7
+			M|imm_b,M|imm_z,X,      M|imm_b,M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      S,     // 8
+			0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      X,      0,      0,      0,      0,      0,     // 9
+			imm_moffs,imm_moffs,imm_moffs,imm_moffs,0,0,    0,      0,      imm_b,  imm_z,  0,      0,      0,      0,      0,      0,     // A
+			imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_v,  imm_v,  imm_v,  imm_v,  imm_v,  imm_v,  imm_v,  imm_v, // B
+			M|imm_b,M|imm_b,imm_w,  0,      S,      S,      M|imm_b,M|imm_z,imm_enter,0,    imm_w,  0,      0,      imm_b,  X,      0,     // C
+			M,      M,      M,      M,      X,      X,      X,      0,      M,      M,      M,      M,      M,      M,      M,      M,     // D
+			imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_b,  imm_rel,imm_rel,X,      imm_b,  0,      0,      0,      0,     // E
+			P,      0,      P,      P,      0,      0,      M|imm_test_b,M|imm_test_z,0,0, 0,      0,      0,      0,      M,      M,     // F
+		};
+
+		// Two-byte opcode map following 0x0F, escapes to the three-byte maps are special.
+		//
+		static constexpr uint8_t two_byte_table[ 256 ] = {
+		//  0       1       2       3       4       5       6       7       8       9       A       B       C       D       E       F
+			M,      M,      M,      M,      X,      0,      0,      0,      0,      0,      X,      0,      X,      M,      0,      S,     // 0
+			M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,     // 1
+			M,      M,      M,      M,      X,      X,      X,      X,      M,      M,      M,      M,      M,      M,      M,      M,     // 2
+			0,      0,      0,      0,      0,      0,      X,      0,      S,      X,      S,      X,      X,      X,      X,      X,     // 3
+			M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,     // 4
+			M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,     // 5
+			M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,     // 6
+			M|imm_b,M|imm_b,M|imm_b,M|imm_b,M,      M,      M,      0,      S,      M,      X,      X,      M,      M,      M,      M,     // 7
+			imm_rel,imm_rel,imm_rel,imm_rel,imm_rel,imm_rel,imm_rel,imm_rel,imm_rel,imm_rel,imm_rel,imm_rel,imm_rel,imm_rel,imm_rel,imm_rel, // 8
+			M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,     // 9
+			0,      0,      0,      M,      M|imm_b,M,      M,      M,      0,      0,      0,      M,      M|imm_b,M,      M,      M,     // A
+			M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M|imm_b,M,      M,      M,      M,      M,     // B
+			M,      M,      M|imm_b,M,      M|imm_b,M|imm_b,M|imm_b,M,      0,      0,      0,      0,      0,      0,      0,      0,     // C
+			M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,     // D
+			M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,     // E
+			M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,     // F
+		};
+
+		// VEX and EVEX encoded instructions always have a ModRM byte except for vzeroupper and 
+		// vzeroall, the immediates of map 1 are the same as the legacy two-byte map.
+		//
+		static constexpr std::array<uint8_t, 256> vex_map1_table = [ ] ()
+		{
+			std::array<uint8_t, 256> t = {};
+			for ( auto& e : t ) e = M;
+			for ( uint8_t op : { 0x70, 0x71, 0x72, 0x73, 0xC2, 0xC4, 0xC5, 0xC6 } )
+				t[ op ] = M | imm_b;
+			t[ 0x77 ] = 0;
+			return t;
+		}();
+
+		// Reads the ModRM byte and skips the SIB byte and the displacement.
+		//
+		__forceinline static bool skip_modrm( const uint8_t* bytes, size_t& pos, size_t limit, uint8_t& modrm )
+		{
+			if ( pos >= limit ) return false;
+			modrm = bytes[ pos++ ];
+			uint8_t mod = modrm >> 6;
+			uint8_t rm = modrm & 7;
+			if ( mod == 3 ) return true;
+
+			if ( rm == 4 )
+			{
+				if ( pos >= limit ) return false;
+				if ( mod == 0 && ( bytes[ pos ] & 7 ) == 5 ) 
+					pos += 4;
+				pos++;
+			}
+			else if ( mod == 0 && rm == 5 )
+			{
+				pos += 4;
+			}
+			if ( mod == 1 ) pos += 1;
+			else if ( mod == 2 ) pos += 4;
+			return true;
+		}
+	};
+
+	// Returns the length of the instruction at the given address decoding at most [size] bytes,
+	// zero if the encoding is invalid or truncated.
+	//
+	size_t instruction_length( const void* data, size_t size )
+	{
+		using namespace impl;
+
+		const uint8_t* bytes = ( const uint8_t* ) data;
+		size_t limit = std::min( size, max_instruction_length );
+		size_t pos = 0;
+
+		// Walk the legacy prefixes and REX, REX is ignored unless it immediately precedes the opcode.
+		//
+		bool opsize = false;
+		bool adsize = false;
+		uint8_t rep = 0;
+		uint8_t rex = 0;
+		uint8_t op, flags;
+		while ( true )
+		{
+			if ( pos >= limit ) return 0;
+			op = bytes[ pos++ ];
+			flags = one_byte_table[ op ];
+
+			if ( flags & op_prefix )
+			{
+				if ( op == 0x66 ) opsize = true;
+				else if ( op == 0x67 ) adsize = true;
+				else if ( op == 0xF2 || op == 0xF3 ) rep = op;
+				rex = 0;
+			}
+			else if ( ( op & 0xF0 ) == 0x40 )
+			{
+				rex = op;
+			}
+			else
+			{
+				break;
+			}
+		}
+		bool rex_w = rex & 8;
+
+		// Resolve the escapes and the vector prefixes.
+		//
+		bool escaped = flags & op_special;
+		if ( escaped )
+		{
+			switch ( op )
+			{
+				case 0x0F:
+					if ( pos >= limit ) return 0;
+					op = bytes[ pos++ ];
+					if ( op == 0x38 || op == 0x3A )
+					{
+						if ( pos >= limit ) return 0;
+						pos++;
+						flags = op == 0x38 ? M : M | imm_b;
+					}
+					// 3DNow! instructions end with an imm8 suffix.
+					//
+					else if ( op == 0x0F )
+					{
+						flags = M | imm_b;
+					}
+					// SSE4a extrq/insertq take two imm8s.
+					//
+					else if ( op == 0x78 )
+					{
+						flags = M | imm_sse4a;
+					}
+					else
+					{
+						flags = two_byte_table[ op ];
+					}
+					break;
+
+				// VEX with two or three bytes, EVEX and XOP.
+				//
+				case 0xC5:
+				case 0xC4:
+				case 0x62:
+				case 0x8F:
+				{
+					if ( pos >= limit ) return 0;
+					uint8_t escape = op;
+					uint8_t p0 = bytes[ pos ];
+
+					// 8F is XOP only if the map select is not a valid ModRM of pop.
+					//
+					if ( escape == 0x8F && ( p0 & 0x1F ) < 8 )
+					{
+						flags = M;
+						break;
+					}
+					if ( rex ) 
+						return 0;
+
+					pos += escape == 0xC5 ? 1 : escape == 0x62 ? 3 : 2;
+					if ( pos >= limit ) return 0;
+					op = bytes[ pos++ ];
+
+					// Resolve the map, XOP maps are tagged to avoid clashing with the VEX maps.
+					//
+					uint8_t map;
+					switch ( escape )
+					{
+						case 0xC5: map = 1; break;
+						case 0xC4: map = p0 & 0x1F; break;
+						case 0x62: map = p0 & 7; break;
+						default:   map = 0x80 | ( p0 & 0x1F ); break;
+					}
+					switch ( map )
+					{
+						case 1:    flags = vex_map1_table[ op ]; break;
+						case 2:    flags = M; break;
+						case 3:    flags = M | imm_b; break;
+						case 0x88: flags = M | imm_b; break;
+						case 0x89: flags = M; break;
+						case 0x8A: flags = M | imm_d; break;
+
+						// EVEX maps 5 and 6 hold the FP16 instructions.
+						//
+						case 5:
+						case 6:
+							if ( escape != 0x62 ) return 0;
+							flags = M;
+							break;
+						default:
+							return 0;
+					}
+
+					// EVEX always has a ModRM byte.
+					//
+					if ( escape == 0x62 )
+						flags |= M;
+					break;
+				}
+				default:
+					return 0;
+			}
+		}
+		if ( flags & op_invalid )
+			return 0;
+
+		// Skip the ModRM, SIB and displacement.
+		//
+		uint8_t modrm = 0;
+		if ( ( flags & has_modrm ) && !skip_modrm( bytes, pos, limit, modrm ) )
+			return 0;
+
+		// Reject the undefined members of the inc/dec groups.
+		//
+		uint8_t reg = ( modrm >> 3 ) & 7;
+		if ( !escaped && ( ( op == 0xFE && reg >= 2 ) || ( op == 0xFF && reg == 7 ) ) )
+			return 0;
+
+		// Skip the immediate.
+		// - Near branches take a rel16 with the operand size override, call and jmp (E8/E9) 
+		//   follow the operand size so REX.W restores the rel32, whereas jcc (0F 8x) keeps
+		//   the rel16 regardless of REX.W, matching the LLVM decoder Capstone is based on.
+		//
+		size_t iz = ( opsize && !rex_w ) ? 2 : 4;
+		bool is_test = reg < 2;
+		switch ( flags & imm_mask )
+		{
+			case imm_b:      pos += 1; break;
+			case imm_w:      pos += 2; break;
+			case imm_z:      pos += iz; break;
+			case imm_v:      pos += rex_w ? 8 : iz; break;
+			case imm_moffs:  pos += adsize ? 4 : 8; break;
+			case imm_enter:  pos += 3; break;
+			case imm_test_b: pos += is_test ? 1 : 0; break;
+			case imm_test_z: pos += is_test ? iz : 0; break;
+			case imm_d:      pos += 4; break;
+			case imm_rel:    pos += ( opsize && ( escaped || !rex_w ) ) ? 2 : 4; break;
+			case imm_sse4a:  pos += ( modrm >> 6 ) == 3 && ( opsize || rep == 0xF2 ) ? 2 : 0; break;
+			default:         break;
+		}
+		return pos <= limit ? pos : 0;
+	}
+
+	// Appends the length of each instruction found by a linear sweep over the given range to [out],
+	// stops at the first invalid or truncated instruction. Returns the number of instructions found.
+	//
+	size_t sweep_lengths( std::vector<uint8_t>& out, const void* bytes, size_t size )
+	{
+		const uint8_t* it = ( const uint8_t* ) bytes;
+		size_t n = 0;
+		while ( size )
+		{
+			size_t length = instruction_length( it, size );
+			if ( !length ) break;
+			out.push_back( ( uint8_t ) length );
+			it += length;
+			size -= length;
+			n++;
+		}
+		return n;
+	}
+
+	// Determines the length of [samples] randomly generated byte sequences with both the length
+	// decoder and Capstone and compares the results, sequences Capstone rejects are only counted.
+	// First [max_details] mismatches are described in the report.
+	//
+	length_decoder_report verify_length_decoder( size_t samples, uint64_t seed, size_t max_details )
+	{
+		static constexpr uint8_t prefixes[] = { 0x66, 0x67, 0xF0, 0xF2, 0xF3, 0x2E, 0x64, 0x65 };
+		static constexpr uint8_t escapes[] = { 0x0F, 0xC4, 0xC5, 0x62, 0x8F };
+
+		length_decoder_report report;
+		std::mt19937_64 rng{ seed };
+		for ( size_t n = 0; n != samples; n++ )
+		{
+			// Generate random bytes, biased towards prefixed and escaped encodings since
+			// uniformly random bytes mostly hit the one-byte map.
+			//
+			uint8_t bytes[ max_instruction_length ];
+			for ( uint8_t& b : bytes )
+				b = ( uint8_t ) rng();
+			size_t pos = 0;
+			if ( !( rng() % 4 ) ) bytes[ pos++ ] = prefixes[ rng() % std::size( prefixes ) ];
+			if ( !( rng() % 4 ) ) bytes[ pos++ ] = 0x40 | ( rng() % 16 );
+			if ( rng() % 2 ) bytes[ pos++ ] = escapes[ rng() % std::size( escapes ) ];
+
+			report.samples++;
+			size_t length = instruction_length( bytes, sizeof( bytes ) );
+			size_t reference = 0;
+			capstone::disasm_stream( bytes, 0, sizeof( bytes ), [ & ] ( const cs_insn& in ) { reference = in.size; }, 1, false );
+
+			if ( !reference )
+			{
+				report.rejected_by_capstone++;
+				continue;
+			}
+			report.compared++;
+
+			if ( length != reference )
+			{
+				report.mismatches++;
+				if ( report.details.size() < max_details )
+				{
+					std::string hex;
+					for ( uint8_t b : bytes )
+						hex += format::str( "%02x", b );
+					report.details.push_back( format::str( "%s: %llu bytes, expected %llu", hex, ( unsigned long long ) length, ( unsigned long long ) reference ) );
+				}
+			}
+		}
+		return report;
+	}
+};
\ No newline at end of file
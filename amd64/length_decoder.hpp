@@ -0,0 +1,81 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+
+// Furthermore, the following pieces of software have additional copyrights
+// licenses, and/or restrictions:
+//
+// |--------------------------------------------------------------------------|
+// | File name               | Link for further information                   |
+// |-------------------------|------------------------------------------------|
+// | amd64/*                 | https://github.com/aquynh/capstone/            |
+// |                         | https://github.com/keystone-engine/keystone/   |
+// |--------------------------------------------------------------------------|
+//
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Table-driven decoder that only determines the length of x86-64 instructions, walking the
+// legacy prefixes, REX, VEX, EVEX and XOP prefixes, the opcode maps, ModRM, SIB, displacement
+// and immediate without decoding any of the operands. Meant for finding instruction boundaries
+// when the instructions themselves are not needed.
+// - Lengths of undefined opcodes within a valid map are computed from the layout of the map,
+//   so the result can be non-zero where Capstone rejects the encoding.
+//
+namespace vtil::amd64
+{
+	static constexpr size_t max_instruction_length = 15;
+
+	// Returns the length of the instruction at the given address decoding at most [size] bytes,
+	// zero if the encoding is invalid or truncated.
+	//
+	size_t instruction_length( const void* bytes, size_t size = max_instruction_length );
+
+	// Appends the length of each instruction found by a linear sweep over the given range to [out],
+	// stops at the first invalid or truncated instruction. Returns the number of instructions found.
+	//
+	size_t sweep_lengths( std::vector<uint8_t>& out, const void* bytes, size_t size );
+
+	// Result of the verification against Capstone.
+	//
+	struct length_decoder_report
+	{
+		size_t samples = 0;
+		size_t compared = 0;
+		size_t mismatches = 0;
+		size_t rejected_by_capstone = 0;
+		std::vector<std::string> details;
+	};
+
+	// Determines the length of [samples] randomly generated byte sequences with both the length
+	// decoder and Capstone and compares the results, sequences Capstone rejects are only counted.
+	// First [max_details] mismatches are described in the report.
+	//
+	length_decoder_report verify_length_decoder( size_t samples = 1000000, uint64_t seed = 0, size_t max_details = 16 );
+};
\ No newline at end of file
@@ -0,0 +1,192 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+
+// Furthermore, the following pieces of software have additional copyrights
+// licenses, and/or restrictions:
+//
+// |--------------------------------------------------------------------------|
+// | File name               | Link for further information                   |
+// |-------------------------|------------------------------------------------|
+// | amd64/*                 | https://github.com/aquynh/capstone/            |
+// |                         | https://github.com/keystone-engine/keystone/   |
+// |--------------------------------------------------------------------------|
+//
+#include "parallel_disassembly.hpp"
+#include "disassembly.hpp"
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+namespace vtil::amd64
+{
+	// Minimum number of bytes per thread decoding the region.
+	//
+	static constexpr size_t min_bytes_per_thread = 1024 * 1024;
+
+	// Region being swept.
+	//
+	struct sweep_input
+	{
+		const uint8_t* base;
+		uint64_t address;
+		size_t size;
+	};
+
+	// Chunk of the region and the instructions decoded starting from its beginning.
+	//
+	struct sweep_chunk
+	{
+		size_t begin;
+		size_t end;
+		size_t next;
+		std::vector<compact_instruction> instructions;
+	};
+
+	// Sweeps linearly from [offset] until the next instruction would start at or after [end], or
+	// at an offset [stop] accepts. Instructions may extend past [end], returns the offset of the
+	// next instruction.
+	//
+	template<typename fn_stop>
+	static size_t sweep( const sweep_input& in, size_t offset, size_t end, std::vector<compact_instruction>& out, fn_stop&& stop )
+	{
+		while ( offset < end && !stop( offset ) )
+		{
+			capstone::disasm_stream( in.base + offset, in.address + offset, in.size - offset, [ & ] ( const cs_insn& insn )
+			{
+				out.emplace_back().assign( insn );
+				offset += insn.size;
+				return offset < end && !stop( offset );
+			} );
+
+			// If the stream stopped at an invalid instruction, skip a byte.
+			//
+			if ( offset < end && !stop( offset ) )
+				offset++;
+		}
+		return offset;
+	}
+
+	// Returns the first instruction in the chunk starting at or after the given offset.
+	//
+	static auto lower_bound( const sweep_input& in, sweep_chunk& chunk, size_t offset )
+	{
+		return std::lower_bound( chunk.instructions.begin(), chunk.instructions.end(), in.address + offset, [ ] ( const compact_instruction& ins, uint64_t address )
+		{
+			return ins.address < address;
+		} );
+	}
+
+	// Disassembles the region linearly using multiple threads.
+	//
+	sweep_result parallel_sweep( const void* bytes, uint64_t address, size_t size, size_t thread_count, size_t chunk_size )
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		sweep_input in = { ( const uint8_t* ) bytes, address, size };
+
+		// Split the region into chunks.
+		//
+		chunk_size = std::max<size_t>( chunk_size, compact_instruction::max_length );
+		std::vector<sweep_chunk> chunks( ( size + chunk_size - 1 ) / chunk_size );
+		for ( size_t i = 0; i != chunks.size(); i++ )
+		{
+			chunks[ i ].begin = i * chunk_size;
+			chunks[ i ].end = std::min( size, ( i + 1 ) * chunk_size );
+		}
+
+		// Decode each chunk from its beginning, each worker uses the engine of its own thread.
+		// Threads are only created if each has enough bytes to decode to pay for its creation,
+		// so smaller regions are swept on the calling thread alone.
+		//
+		if ( !thread_count )
+			thread_count = std::max( 1u, std::thread::hardware_concurrency() );
+		thread_count = std::min( { thread_count, chunks.size(), std::max<size_t>( size / min_bytes_per_thread, 1 ) } );
+
+		std::atomic<size_t> next_chunk = 0;
+		auto worker = [ & ] ()
+		{
+			for ( size_t i; ( i = next_chunk++ ) < chunks.size(); )
+			{
+				sweep_chunk& chunk = chunks[ i ];
+				chunk.instructions.reserve( ( chunk.end - chunk.begin ) / 4 );
+				chunk.next = sweep( in, chunk.begin, chunk.end, chunk.instructions, [ ] ( size_t ) { return false; } );
+			}
+		};
+		std::vector<std::thread> workers;
+		for ( size_t i = 1; i < thread_count; i++ )
+			workers.emplace_back( worker );
+		worker();
+		for ( auto& thread : workers )
+			thread.join();
+
+		// Stitch the chunks together in order.
+		//
+		sweep_result result;
+		size_t total = 0;
+		for ( auto& chunk : chunks )
+			total += chunk.instructions.size();
+		result.instructions.reserve( total );
+
+		size_t offset = 0;
+		for ( auto& chunk : chunks )
+		{
+			// If the previous chunk ended past this chunk entirely, skip it.
+			//
+			if ( offset >= chunk.end )
+				continue;
+
+			// If the previous chunk did not end exactly at the beginning of this chunk, 
+			// see if the stream is already synchronized with an instruction of this chunk, 
+			// otherwise re-decode until it is.
+			//
+			auto it = lower_bound( in, chunk, offset );
+			if ( it == chunk.instructions.end() || it->address != ( in.address + offset ) )
+			{
+				offset = sweep( in, offset, chunk.end, result.instructions, [ & ] ( size_t offset )
+				{
+					auto it = lower_bound( in, chunk, offset );
+					return it != chunk.instructions.end() && it->address == ( in.address + offset );
+				} );
+
+				// If it never synchronized, the re-decoded instructions replace the chunk.
+				//
+				if ( offset >= chunk.end )
+					continue;
+				it = lower_bound( in, chunk, offset );
+			}
+
+			result.instructions.insert( result.instructions.end(), it, chunk.instructions.end() );
+			offset = chunk.next;
+			chunk.instructions = {};
+		}
+
+		result.bytes = size;
+		result.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+		return result;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,71 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+
+// Furthermore, the following pieces of software have additional copyrights
+// licenses, and/or restrictions:
+//
+// |--------------------------------------------------------------------------|
+// | File name               | Link for further information                   |
+// |-------------------------|------------------------------------------------|
+// | amd64/*                 | https://github.com/aquynh/capstone/            |
+// |                         | https://github.com/keystone-engine/keystone/   |
+// |--------------------------------------------------------------------------|
+//
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "compact_instruction.hpp"
+
+namespace vtil::amd64
+{
+	// Result of a linear sweep over a code region.
+	//
+	struct sweep_result
+	{
+		// Instructions decoded, ordered by address. Bytes that could not be
+		// decoded are skipped one at a time.
+		//
+		std::vector<compact_instruction> instructions;
+
+		// Statistics.
+		//
+		size_t bytes = 0;
+		double seconds = 0;
+		double mb_per_second() const { return seconds ? bytes / ( 1024.0 * 1024.0 ) / seconds : 0; }
+	};
+
+	// Disassembles the region linearly using multiple threads, the region is split into 
+	// chunks decoded concurrently which are then stitched together in order, re-decoding
+	// from the end of the previous chunk wherever an instruction straddles the boundary
+	// until the stream synchronizes with the chunk again.
+	// - If [thread_count] is zero, the number of hardware threads is used.
+	// - The number of threads is limited so that each decodes at least a megabyte, regions
+	//   smaller than that are swept on the calling thread without creating any threads.
+	//
+	sweep_result parallel_sweep( const void* bytes, uint64_t address, size_t size, size_t thread_count = 0, size_t chunk_size = 256 * 1024 );
+};
\ No newline at end of file
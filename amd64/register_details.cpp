@@ -37,12 +37,13 @@
 // |--------------------------------------------------------------------------|
 //
 #include "register_details.hpp"
+#include <array>
 
 namespace vtil::amd64
 {
     // List of all physical registers and the base registers they map to <0> at offset <1> of size <2>.
     //
-    static const std::map<x86_reg, register_mapping> register_mappings
+    static constexpr std::pair<x86_reg, register_mapping> register_mappings[] =
     {
         /* [Instance]           [Base]       [Offset] [Size]  */
         { X86_REG_RAX,		{ X86_REG_RAX,		0,		8	} },
@@ -132,45 +133,68 @@ namespace vtil::amd64
         { X86_REG_EFLAGS,	{ X86_REG_EFLAGS,	0,		8	} },
     };
 
+    // Flat tables generated from the list above so that each query is a single load, 
+    // indexed by the register for the mapping and by [base][offset][size] for the 
+    // reverse lookup. Registers that are not listed map to themselves.
+    //
+    static_assert( X86_REG_ENDING <= 256, "Register identifiers do not fit the mapping tables." );
+    static constexpr auto mapping_table = [ ] ()
+    {
+        std::array<register_mapping, 256> table = {};
+        for ( size_t i = 0; i != table.size(); i++ )
+            table[ i ] = { ( x86_reg ) i, 0, 8 };
+        for ( auto& [reg, mapping] : register_mappings )
+            table[ reg ] = mapping;
+        return table;
+    }( );
+
+    static constexpr auto remap_table = [ ] ()
+    {
+        std::array<std::array<std::array<uint8_t, 9>, 2>, 256> table = {};
+        for ( auto& [reg, mapping] : register_mappings )
+            table[ mapping.base_register ][ mapping.offset ][ mapping.size ] = ( uint8_t ) reg;
+        return table;
+    }( );
+
     // Gets the offset<0> and size<1> of the mapping for the given register.
     //
     register_mapping resolve_mapping( uint8_t _reg )
     {
-        // Try to find the register mapping, if successful return if
-        //
-        auto it = register_mappings.find( ( x86_reg ) _reg );
-        if ( it != register_mappings.end() )
-            return it->second;
-
-        // Otherwise return default mapping after making sure it's valid.
+        // Make sure the register is valid and return the mapping, 
+        // unlisted registers have the default mapping.
         //
         fassert( _reg != X86_REG_INVALID );
-        return { ( x86_reg ) _reg, 0, 8 };
+        return mapping_table[ _reg ];
     }
 
     // Gets the base register for the given register.
     //
     x86_reg extend( uint8_t _reg )
     {
-        // Try to find the register mapping, 
-        // return as is if we fail to do so.
-        //
-        auto it = register_mappings.find( ( x86_reg ) _reg );
-        if ( it == register_mappings.end() )
-            return ( x86_reg ) _reg;
-
-        // Otherwise return the base register.
+        // Return the base register, unlisted registers map to themselves.
         //
-        return it->second.base_register;
+        return mapping_table[ _reg ].base_register;
     }
 
     // Converts the enum into human-readable format.
     //
-    std::string name( uint8_t _reg )
+    interned_string name( uint8_t _reg )
     {
-        // Else lookup the name from capstone.
+        // Lookup the names of all registers from capstone once and intern them.
         //
-        return cs_reg_name( capstone::get_handle(), ( x86_reg ) _reg );
+        static const auto names = [ ] ()
+        {
+            std::array<interned_string, X86_REG_ENDING> result;
+            for ( size_t i = X86_REG_INVALID + 1; i != X86_REG_ENDING; i++ )
+            {
+                if ( const char* str = cs_reg_name( capstone::get_handle(), ( x86_reg ) i ) )
+                    result[ i ] = intern( str );
+            }
+            return result;
+        }( );
+
+        fcheck( _reg < X86_REG_ENDING );
+        return names[ _reg ];
     }
 
     // Remaps the given register at given specifications.
@@ -181,16 +205,12 @@ namespace vtil::amd64
         //
         x86_reg base_register = extend( _reg );
 
-        // For each mapping described:
+        // If there is a register matching the specifications, return it.
         //
-        for ( auto& pair : register_mappings )
+        if ( offset < 2 && size < 9 )
         {
-            // If matches the specifications, return.
-            //
-            if ( pair.second.base_register == base_register &&
-                 pair.second.offset == offset &&
-                 pair.second.size == size )
-                return pair.first;
+            if ( uint8_t reg = remap_table[ base_register ][ offset ][ size ] )
+                return ( x86_reg ) reg;
         }
 
         // If we fail to find, and we're strictly
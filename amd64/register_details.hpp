@@ -74,7 +74,7 @@ namespace vtil::amd64
 
 	// Converts the enum into human-readable format.
 	//
-	std::string name( uint8_t _reg );
+	interned_string name( uint8_t _reg );
 
 	// Remaps the given register at given specifications.
 	//
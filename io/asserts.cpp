@@ -0,0 +1,71 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#include "asserts.hpp"
+#include <vector>
+#include <algorithm>
+
+namespace vtil::assert
+{
+	// Reports the assertion failure and breaks the execution.
+	//
+	void impl::fail( const char* file_name, const char* condition_str, uint32_t line_number )
+	{
+		logger::error
+		(
+			"Assertion failure at %s:%d (%s)",
+			file_name,
+			line_number,
+			condition_str
+		);
+	}
+
+	// Logs the number of times each assertion site was evaluated, in descending order.
+	//
+	void report_sites()
+	{
+		std::vector<const site*> sites;
+		for ( const site* it = impl::site_list.load(); it; it = it->next )
+			sites.push_back( it );
+		std::sort( sites.begin(), sites.end(), [ ] ( const site* a, const site* b )
+		{
+			return a->hits.load( std::memory_order_relaxed ) > b->hits.load( std::memory_order_relaxed );
+		} );
+
+		logger::log<logger::CON_YLW>( "Assertion report (%llu sites):\n", sites.size() );
+		logger::scope_padding _p( 1 );
+		for ( const site* it : sites )
+		{
+			logger::log
+			(
+				"%s:%d (%s): %llu hits\n", 
+				it->file_name, it->line_number, it->condition_str, 
+				it->hits.load( std::memory_order_relaxed )
+			);
+		}
+	}
+};
\ No newline at end of file
@@ -27,28 +27,82 @@
 //
 #pragma once
 #include <stdint.h>
+#include <atomic>
 #include "logger.hpp"
 
+// Assertions come in two tiers:
+// - fcheck: Cheap checks that are kept in every build, the condition is hinted as likely
+//   and the failure path is kept out-of-line so the cost is a compare and a branch.
+// - fassert: Expensive checks that are only compiled in debug builds.
+//
+// If VTIL_ASSERT_COUNTERS is defined, each assertion site also counts the number of
+// times it was evaluated, which can be logged with assert::report_sites().
+//
 namespace vtil::assert
 {
-	namespace impl { __declspec( noreturn ) __forceinline static void noreturn_helper() { __debugbreak(); } };
+	// Assertion site with the number of times it was evaluated, sites register
+	// themselves on construction so they must have static storage duration.
+	//
+	struct site;
+	namespace impl { inline std::atomic<site*> site_list = nullptr; };
+	struct site
+	{
+		const char* file_name;
+		const char* condition_str;
+		uint32_t line_number;
+		std::atomic<uint64_t> hits = 0;
+		site* next = nullptr;
+
+		site( const char* file_name, const char* condition_str, uint32_t line_number )
+			: file_name( file_name ), condition_str( condition_str ), line_number( line_number )
+		{
+			next = impl::site_list.load();
+			while ( !impl::site_list.compare_exchange_weak( next, this ) );
+		}
+		site( site&& ) = delete;
+		site( const site& ) = delete;
+
+		__forceinline void hit() { hits.fetch_add( 1, std::memory_order_relaxed ); }
+	};
+
+	// Logs the number of times each assertion site was evaluated, in descending order.
+	//
+	void report_sites();
+
+	namespace impl 
+	{ 
+		__declspec( noreturn ) __forceinline static void noreturn_helper() { __debugbreak(); } 
+
+		// Reports the assertion failure and breaks the execution, kept out-of-line 
+		// so that the callers only pay for the branch.
+		//
+		__declspec( noreturn ) __declspec( noinline ) void fail( const char* file_name, const char* condition_str, uint32_t line_number );
+	};
 
 	static void or_die( bool condition, const char* file_name, const char* condition_str, uint32_t line_number )
 	{
-		if ( condition ) return;
-		logger::error
-		(
-			"Assertion failure at %s:%d (%s)",
-			file_name,
-			line_number,
-			condition_str
-		);
+		if ( condition ) [[likely]] return;
+		impl::fail( file_name, condition_str, line_number );
 	}
 };
 
+#define fassert__stringify(x) #x
+#ifdef VTIL_ASSERT_COUNTERS
+	#define fassert__count(x) static vtil::assert::site __assert_site( __FILE__, fassert__stringify(x), __LINE__ ); __assert_site.hit()
+#else
+	#define fassert__count(x)
+#endif
+#define fcheck(x)                                                                     \
+	do                                                                                \
+	{                                                                                 \
+		fassert__count(x);                                                            \
+		if ( !( x ) ) [[unlikely]]                                                    \
+			vtil::assert::impl::fail( __FILE__, fassert__stringify(x), __LINE__ );    \
+	}                                                                                 \
+	while ( 0 )
+
 #ifdef _DEBUG
-	#define fassert__stringify(x) #x
-	#define fassert(x) vtil::assert::or_die( (x), __FILE__, fassert__stringify(x), __LINE__ )
+	#define fassert(x) fcheck(x)
 #else
 	#define fassert(...)
 #endif
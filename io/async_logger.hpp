@@ -0,0 +1,371 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+#include "formatting.hpp"
+
+// Asynchronous logging serializes the format string and the raw arguments into
+// a per-thread ring buffer on the calling thread, the records are formatted and
+// written in batches by a background thread.
+// - Entries that cannot be serialized are formatted on the calling thread and
+//   buffered as text so that the order within the thread is preserved.
+//
+namespace vtil::logger::impl
+{
+	// Whether the argument is a narrow or wide string, in which case the contents are
+	// copied into the record instead of the pointer.
+	//
+	template<typename T>
+	static constexpr bool is_narrow_string_v = std::is_convertible_v<const std::remove_cvref_t<T>&, std::string_view>;
+	template<typename T>
+	static constexpr bool is_wide_string_v = std::is_convertible_v<const std::remove_cvref_t<T>&, std::wstring_view>;
+
+	// Whether the argument can be serialized, any other argument will be logged synchronously.
+	//
+	template<typename T>
+	static constexpr bool is_serializable_v = is_narrow_string_v<T> || is_wide_string_v<T> || std::is_trivially_copyable_v<std::remove_cvref_t<T>>;
+
+	// Converts a string argument to a view, null pointers are replaced with "(null)".
+	//
+	template<typename T>
+	__forceinline static std::string_view to_narrow_view( const T& value )
+	{
+		if constexpr ( std::is_pointer_v<std::decay_t<T>> )
+			if ( !value ) return "(null)";
+		return value;
+	}
+	template<typename T>
+	__forceinline static std::wstring_view to_wide_view( const T& value )
+	{
+		if constexpr ( std::is_pointer_v<std::decay_t<T>> )
+			if ( !value ) return L"(null)";
+		return value;
+	}
+
+	// Returns the number of bytes the argument takes once serialized.
+	//
+	template<typename T>
+	__forceinline static size_t serialized_size( const T& value )
+	{
+		if constexpr ( is_narrow_string_v<T> )
+			return sizeof( uint32_t ) + to_narrow_view( value ).size() + 1;
+		else if constexpr ( is_wide_string_v<T> )
+			return sizeof( uint32_t ) + to_wide_view( value ).size() * sizeof( wchar_t );
+		else
+			return sizeof( std::remove_cvref_t<T> );
+	}
+
+	// Serializes the argument into the buffer and advances the iterator.
+	// - Strings are stored as [uint32_t length][characters] and narrow strings
+	//   are null-terminated so that they can be referenced in place.
+	//
+	template<typename T>
+	__forceinline static void serialize( uint8_t*& it, const T& value )
+	{
+		if constexpr ( is_narrow_string_v<T> )
+		{
+			std::string_view view = to_narrow_view( value );
+			uint32_t length = ( uint32_t ) view.size();
+			memcpy( it, &length, sizeof( uint32_t ) );
+			memcpy( it + sizeof( uint32_t ), view.data(), length );
+			it[ sizeof( uint32_t ) + length ] = 0;
+			it += sizeof( uint32_t ) + length + 1;
+		}
+		else if constexpr ( is_wide_string_v<T> )
+		{
+			std::wstring_view view = to_wide_view( value );
+			uint32_t length = ( uint32_t ) view.size();
+			memcpy( it, &length, sizeof( uint32_t ) );
+			memcpy( it + sizeof( uint32_t ), view.data(), length * sizeof( wchar_t ) );
+			it += sizeof( uint32_t ) + length * sizeof( wchar_t );
+		}
+		else
+		{
+			memcpy( it, &value, sizeof( std::remove_cvref_t<T> ) );
+			it += sizeof( std::remove_cvref_t<T> );
+		}
+	}
+
+	// Deserializes the argument from the buffer and advances the iterator.
+	// - Narrow strings are referenced in place, wide strings are copied as they
+	//   may not be properly aligned.
+	//
+	template<typename T>
+	__forceinline static auto deserialize( const uint8_t*& it )
+	{
+		if constexpr ( is_narrow_string_v<T> )
+		{
+			uint32_t length;
+			memcpy( &length, it, sizeof( uint32_t ) );
+			const char* str = ( const char* ) ( it + sizeof( uint32_t ) );
+			it += sizeof( uint32_t ) + length + 1;
+			return str;
+		}
+		else if constexpr ( is_wide_string_v<T> )
+		{
+			uint32_t length;
+			memcpy( &length, it, sizeof( uint32_t ) );
+			std::wstring str( length, L'\0' );
+			memcpy( str.data(), it + sizeof( uint32_t ), length * sizeof( wchar_t ) );
+			it += sizeof( uint32_t ) + length * sizeof( wchar_t );
+			return str;
+		}
+		else
+		{
+			std::remove_cvref_t<T> value;
+			memcpy( &value, it, sizeof( value ) );
+			it += sizeof( value );
+			return value;
+		}
+	}
+
+	// Formats a serialized record, instantiated per argument list.
+	//
+	using fn_formatter = void( * )( const char* fmt, const uint8_t* data, std::string& out );
+	template<typename... params>
+	static void format_record( const char* fmt, const uint8_t* data, std::string& out )
+	{
+		// Braced initialization guarantees left-to-right evaluation.
+		//
+		std::tuple<decltype( deserialize<params>( data ) )...> args{ deserialize<params>( data )... };
+		std::apply( [ & ] ( auto&... values ) { out += format::str( fmt, values... ); }, args );
+	}
+
+	// Formatter of records holding text that was already formatted in place of the format string.
+	//
+	static void format_verbatim( const char* fmt, const uint8_t*, std::string& out )
+	{
+		out += fmt;
+	}
+
+	// Header of each record in the ring buffer, followed by the null-terminated
+	// format string and the arguments.
+	//
+	struct record_header
+	{
+		// Total size of the record including the header, rounded up to the alignment,
+		// zero indicates that the rest of the ring is skipped.
+		//
+		uint32_t size;
+
+		// Color and the padding prefix of the line.
+		//
+		uint16_t color;
+		uint16_t pad_by;
+		bool padding_bar;
+
+		// Size of the format string including the terminator and the formatter.
+		//
+		uint32_t fmt_size;
+		fn_formatter formatter;
+	};
+	static constexpr size_t record_alignment = 8;
+
+	// Single-producer single-consumer ring buffer of records, the owning thread
+	// produces and the background thread consumes.
+	//
+	struct log_ring
+	{
+		static constexpr size_t capacity = 64 * 1024;
+		static_assert( ( capacity % record_alignment ) == 0, "Ring capacity must be aligned." );
+
+		// Positions are monotonic, index in the buffer is the position modulo the capacity.
+		//
+		alignas( 64 ) std::atomic<size_t> head = 0;
+		alignas( 64 ) std::atomic<size_t> tail = 0;
+		alignas( record_alignment ) uint8_t data[ capacity ];
+
+		// Reserves a contiguous region of [n] bytes, returns nullptr if there is
+		// not enough space at the moment.
+		//
+		uint8_t* reserve( size_t n, size_t& position )
+		{
+			size_t pos = tail.load( std::memory_order_relaxed );
+			size_t offset = pos % capacity;
+			size_t used = pos - head.load( std::memory_order_acquire );
+
+			// If the record does not fit till the end, skip the rest of the buffer.
+			//
+			size_t skip = ( offset + n > capacity ) ? capacity - offset : 0;
+			if ( used + skip + n > capacity )
+				return nullptr;
+			if ( skip )
+			{
+				uint32_t marker = 0;
+				memcpy( data + offset, &marker, sizeof( uint32_t ) );
+				pos += skip;
+			}
+
+			position = pos;
+			return data + ( pos % capacity );
+		}
+
+		// Publishes the record reserved at the given position.
+		//
+		void commit( size_t position, size_t n )
+		{
+			tail.store( position + n, std::memory_order_release );
+		}
+
+		// Consumes every record published so far.
+		//
+		template<typename T>
+		void consume( T&& fn )
+		{
+			size_t pos = head.load( std::memory_order_relaxed );
+			size_t end = tail.load( std::memory_order_acquire );
+			while ( pos != end )
+			{
+				size_t offset = pos % capacity;
+				const record_header* header = ( const record_header* ) ( data + offset );
+				if ( !header->size )
+				{
+					pos += capacity - offset;
+					continue;
+				}
+				fn( *header, ( const uint8_t* ) ( header + 1 ) );
+				pos += header->size;
+			}
+			head.store( pos, std::memory_order_release );
+		}
+	};
+
+	// Returns the ring buffer of the current thread if asynchronous logging is
+	// enabled, nullptr otherwise.
+	// - If the current thread holds the output lock or the registry lock, the background
+	//   thread cannot drain the buffer, so the pending entries of the thread are written
+	//   and nullptr is returned for the entry to be logged synchronously.
+	//
+	log_ring* async_buffer();
+
+	// Wakes up the background thread, invoked when the ring buffer is full.
+	//
+	void async_notify();
+
+	// Writes the entries pending in the ring buffer of the current thread on the current
+	// thread, invoked when the background thread does not drain it in time.
+	//
+	void async_write_local();
+
+	// Largest record that can be buffered.
+	//
+	static constexpr size_t max_record_size = log_ring::capacity / 2;
+
+	// Number of times the background thread is woken up for a full buffer before
+	// the current thread drains it instead.
+	//
+	static constexpr size_t max_reserve_attempts = 256;
+
+	// Reserves a record of [size] bytes in the ring buffer and writes the header and
+	// the format string, returns the pointer to the arguments.
+	//
+	__forceinline static uint8_t* begin_record( log_ring* ring, size_t& position, size_t size, uint16_t color, uint16_t pad_by, bool padding_bar, std::string_view fmt, fn_formatter formatter )
+	{
+		// Reserve the space, if the buffer is full wake up the consumer and wait for a
+		// bounded number of attempts, then drain the buffer on the current thread.
+		//
+		uint8_t* it;
+		for ( size_t n = 0; !( it = ring->reserve( size, position ) ); n++ )
+		{
+			if ( n < max_reserve_attempts )
+				async_notify();
+			else
+				async_write_local();
+		}
+
+		record_header* header = ( record_header* ) it;
+		header->size = ( uint32_t ) size;
+		header->color = color;
+		header->pad_by = pad_by;
+		header->padding_bar = padding_bar;
+		header->fmt_size = ( uint32_t ) fmt.size() + 1;
+		header->formatter = formatter;
+		it += sizeof( record_header );
+		memcpy( it, fmt.data(), fmt.size() );
+		it[ fmt.size() ] = 0;
+		return it + fmt.size() + 1;
+	}
+
+	// Serializes the record into the ring buffer given, returns false if the record
+	// cannot be buffered, in which case the caller should format it and buffer the text.
+	//
+	template<typename... params>
+	static bool enqueue( log_ring* ring, uint16_t color, uint16_t pad_by, bool padding_bar, const char* fmt, const params&... ps )
+	{
+		if constexpr ( !( is_serializable_v<params> && ... ) )
+		{
+			return false;
+		}
+		else
+		{
+			// Calculate the size of the record.
+			//
+			std::string_view fmt_view = fmt;
+			size_t size = sizeof( record_header ) + fmt_view.size() + 1 + ( serialized_size( ps ) + ... + 0 );
+			size = ( size + record_alignment - 1 ) & ~( record_alignment - 1 );
+			if ( size > max_record_size )
+				return false;
+
+			// Write the record and publish it.
+			//
+			size_t position;
+			uint8_t* it = begin_record( ring, position, size, color, pad_by, padding_bar, fmt_view, &format_record<params...> );
+			( serialize( it, ps ), ... );
+			ring->commit( position, size );
+			return true;
+		}
+	}
+
+	// Buffers text that was already formatted, split into multiple records if it does 
+	// not fit into one, only the first of which is padded.
+	//
+	static void enqueue_text( log_ring* ring, uint16_t color, uint16_t pad_by, bool padding_bar, std::string_view text )
+	{
+		static constexpr size_t max_chunk = max_record_size - sizeof( record_header ) - record_alignment;
+		do
+		{
+			std::string_view chunk = text.substr( 0, max_chunk );
+			text.remove_prefix( chunk.size() );
+
+			size_t size = sizeof( record_header ) + chunk.size() + 1;
+			size = ( size + record_alignment - 1 ) & ~( record_alignment - 1 );
+
+			size_t position;
+			begin_record( ring, position, size, color, pad_by, padding_bar, chunk, &format_verbatim );
+			ring->commit( position, size );
+			pad_by = 0;
+		}
+		while ( !text.empty() );
+	}
+};
\ No newline at end of file
@@ -0,0 +1,338 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#include "binary_log.hpp"
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <string_view>
+#include <unordered_map>
+#include <cstdio>
+#include "logger.hpp"
+#include "..\util\mapped_file.hpp"
+
+namespace vtil::logger::impl
+{
+	// Key of a format definition, the contents of the format string and the argument tags.
+	//
+	using format_key = std::pair<std::string_view, std::string_view>;
+	struct format_key_hash
+	{
+		size_t operator()( const format_key& key ) const
+		{
+			return std::hash<std::string_view>{}( key.first ) ^ ( std::hash<std::string_view>{}( key.second ) << 1 );
+		}
+	};
+
+	// State of the binary log.
+	//
+	struct binary_log_state
+	{
+		// Current mapping, null if not open.
+		//
+		std::atomic<binary_log_header*> header = nullptr;
+		mapped_file file;
+
+		// Format definitions keyed by their contents, as the format string may be freed and
+		// its address reused, keys refer to the copies owned by the state.
+		//
+		std::mutex format_mutex;
+		std::deque<std::string> format_strings;
+		std::unordered_map<format_key, uint32_t, format_key_hash> format_ids;
+
+		// Incremented every time a log is opened to invalidate the thread-local caches.
+		//
+		std::atomic<uint32_t> generation = 0;
+	};
+	static binary_log_state binary_state;
+
+	// Returns the header of the binary log if it is open, nullptr otherwise.
+	//
+	binary_log_header* binary_sink()
+	{
+		return binary_state.header.load( std::memory_order_relaxed );
+	}
+
+	// Returns the identifier of the format string with the given argument tags,
+	// recording the definition if it was not used before.
+	//
+	uint32_t binary_format_id( binary_log_header* log, const char* fmt, const char* tags )
+	{
+		format_key key = { fmt, tags };
+
+		// Check the cache of the current thread first, its keys refer to the copies in the
+		// global table which are only released when the generation changes.
+		//
+		static thread_local uint32_t cache_generation = 0;
+		static thread_local std::unordered_map<format_key, uint32_t, format_key_hash> cache;
+		uint32_t generation = binary_state.generation.load( std::memory_order_relaxed );
+		if ( cache_generation != generation )
+		{
+			cache.clear();
+			cache_generation = generation;
+		}
+		if ( auto it = cache.find( key ); it != cache.end() )
+			return it->second;
+
+		// Look up the global table, record the definition if not found.
+		//
+		std::lock_guard g( binary_state.format_mutex );
+		auto it = binary_state.format_ids.find( key );
+		if ( it == binary_state.format_ids.end() )
+		{
+			const std::string& copy = binary_state.format_strings.emplace_back( std::string{ key.first } + '\0' + std::string{ key.second } );
+			format_key owned_key = { std::string_view{ copy }.substr( 0, key.first.size() ), std::string_view{ copy }.substr( key.first.size() + 1 ) };
+			it = binary_state.format_ids.emplace( owned_key, ( uint32_t ) binary_state.format_ids.size() ).first;
+
+			uint32_t fmt_length = ( uint32_t ) key.first.size();
+			uint32_t tag_length = ( uint32_t ) key.second.size();
+			if ( binary_record* record = binary_reserve( log, sizeof( binary_record ) + 2 * sizeof( uint32_t ) + fmt_length + tag_length ) )
+			{
+				record->format_id = it->second;
+				uint8_t* data = ( uint8_t* ) ( record + 1 );
+				memcpy( data, &fmt_length, sizeof( uint32_t ) );
+				memcpy( data + sizeof( uint32_t ), &tag_length, sizeof( uint32_t ) );
+				memcpy( data + 2 * sizeof( uint32_t ), fmt, fmt_length );
+				memcpy( data + 2 * sizeof( uint32_t ) + fmt_length, tags, tag_length );
+				record->kind.store( binary_record_format, std::memory_order_release );
+			}
+		}
+		cache.emplace( it->first, it->second );
+		return it->second;
+	}
+
+	// Formats a single conversion specification with the value read from the entry.
+	//
+	static void format_argument( std::string& out, const std::string& spec, const std::vector<int>& stars, char tag, const uint8_t*& it )
+	{
+		auto format_value = [ & ] ( auto value )
+		{
+			switch ( stars.size() )
+			{
+				case 0:  out += format::str( spec.c_str(), value ); break;
+				case 1:  out += format::str( spec.c_str(), stars[ 0 ], value ); break;
+				default: out += format::str( spec.c_str(), stars[ 0 ], stars[ 1 ], value ); break;
+			}
+		};
+
+		switch ( tag )
+		{
+			case 'c': return format_value( ( int ) deserialize<int8_t>( it ) );
+			case 'C': return format_value( ( unsigned ) deserialize<uint8_t>( it ) );
+			case 'h': return format_value( ( int ) deserialize<int16_t>( it ) );
+			case 'H': return format_value( ( unsigned ) deserialize<uint16_t>( it ) );
+			case 'i': return format_value( deserialize<int32_t>( it ) );
+			case 'I': return format_value( deserialize<uint32_t>( it ) );
+			case 'l': return format_value( deserialize<int64_t>( it ) );
+			case 'L': return format_value( deserialize<uint64_t>( it ) );
+			case 'f': return format_value( ( double ) deserialize<float>( it ) );
+			case 'd': return format_value( deserialize<double>( it ) );
+			case 'p': return format_value( deserialize<void*>( it ) );
+			case 's': return format_value( deserialize<const char*>( it ) );
+			case 'S': return format_value( deserialize<const wchar_t*>( it ) );
+			default:  out += spec; return;
+		}
+	}
+
+	// Reads an integer argument used as a '*' width or precision.
+	//
+	static int read_star( char tag, const uint8_t*& it )
+	{
+		switch ( tag )
+		{
+			case 'c': return deserialize<int8_t>( it );
+			case 'C': return deserialize<uint8_t>( it );
+			case 'h': return deserialize<int16_t>( it );
+			case 'H': return deserialize<uint16_t>( it );
+			case 'i': return deserialize<int32_t>( it );
+			case 'I': return ( int ) deserialize<uint32_t>( it );
+			case 'l': return ( int ) deserialize<int64_t>( it );
+			case 'L': return ( int ) deserialize<uint64_t>( it );
+			default:  return 0;
+		}
+	}
+
+	// Formats a log entry given the format string, the argument tags and the serialized arguments.
+	//
+	static void format_entry( std::string& out, const std::string& fmt, const std::string& tags, const uint8_t* it )
+	{
+		size_t arg_index = 0;
+		for ( size_t i = 0; i < fmt.size(); i++ )
+		{
+			if ( fmt[ i ] != '%' )
+			{
+				out += fmt[ i ];
+				continue;
+			}
+			if ( ( i + 1 ) < fmt.size() && fmt[ i + 1 ] == '%' )
+			{
+				out += '%';
+				i++;
+				continue;
+			}
+
+			// Read the conversion specification, consuming the '*' arguments.
+			//
+			size_t end = fmt.find_first_of( "diouxXeEfFgGaAcspn", i + 1 );
+			if ( end == std::string::npos )
+			{
+				out.append( fmt, i );
+				break;
+			}
+			std::string spec = fmt.substr( i, end - i + 1 );
+			std::vector<int> stars;
+			for ( char c : spec )
+				if ( c == '*' && arg_index < tags.size() )
+					stars.push_back( read_star( tags[ arg_index++ ], it ) );
+
+			// Format the value, if there are no arguments left print the specification as is.
+			//
+			if ( arg_index < tags.size() && spec.back() != 'n' )
+				format_argument( out, spec, stars, tags[ arg_index++ ], it );
+			else
+				out += spec;
+			i = end;
+		}
+	}
+};
+
+namespace vtil::logger
+{
+	// Opens a binary log at the given path with the given capacity.
+	//
+	bool open_binary_log( const std::string& path, size_t capacity )
+	{
+		using namespace impl;
+		close_binary_log();
+
+		capacity = std::max( capacity, sizeof( binary_log_header ) );
+		if ( !binary_state.file.create( path, capacity ) )
+			return false;
+
+		// Initialize the header, the rest of the file is zero-filled.
+		//
+		binary_log_header* header = ( binary_log_header* ) binary_state.file.base;
+		memcpy( header->magic, binary_log_header::expected_magic, sizeof( header->magic ) );
+		header->version = binary_log_header::current_version;
+		header->wchar_size = sizeof( wchar_t );
+		header->capacity = capacity;
+		header->write_offset = ( sizeof( binary_log_header ) + binary_record_alignment - 1 ) & ~( binary_record_alignment - 1 );
+		header->dropped = 0;
+
+		// Reset the format definitions and publish the log.
+		//
+		binary_state.format_ids.clear();
+		binary_state.format_strings.clear();
+		binary_state.generation++;
+		binary_state.header.store( header, std::memory_order_release );
+		return true;
+	}
+
+	// Closes the binary log if it is open.
+	//
+	void close_binary_log()
+	{
+		using namespace impl;
+		if ( binary_state.header.exchange( nullptr ) )
+			binary_state.file.close();
+	}
+
+	// Decodes the binary log file at the given path back into text.
+	//
+	std::string decode_binary_log( const std::string& path )
+	{
+		using namespace impl;
+
+		// Map the whole file.
+		//
+		mapped_file file;
+		file.open( path );
+
+		// Validate the header.
+		//
+		if ( file.size < sizeof( binary_log_header ) )
+			return "Invalid binary log: file is too small.\n";
+		const binary_log_header* header = ( const binary_log_header* ) file.base;
+		if ( memcmp( header->magic, binary_log_header::expected_magic, sizeof( header->magic ) ) )
+			return "Invalid binary log: magic mismatch.\n";
+		if ( header->version != binary_log_header::current_version || header->wchar_size != sizeof( wchar_t ) )
+			return format::str( "Unsupported binary log: version %u, wchar size %u.\n", header->version, header->wchar_size );
+
+		// Enumerates the records in the file.
+		//
+		size_t end = ( size_t ) std::min<uint64_t>( { header->write_offset.load(), header->capacity, file.size } );
+		auto for_each_record = [ & ] ( auto&& fn )
+		{
+			size_t offset = ( sizeof( binary_log_header ) + binary_record_alignment - 1 ) & ~( binary_record_alignment - 1 );
+			while ( ( offset + sizeof( binary_record ) ) <= end )
+			{
+				const binary_record* record = ( const binary_record* ) ( file.base + offset );
+				if ( !record->size || ( offset + record->size ) > end )
+					break;
+				fn( *record );
+				offset += record->size;
+			}
+		};
+
+		// Collect the format definitions first as they may be recorded after
+		// the entries of other threads that are using them.
+		//
+		std::unordered_map<uint32_t, std::pair<std::string, std::string>> formats;
+		for_each_record( [ & ] ( const binary_record& record )
+		{
+			if ( record.kind != binary_record_format )
+				return;
+			const uint8_t* data = ( const uint8_t* ) ( &record + 1 );
+			uint32_t fmt_length, tag_length;
+			memcpy( &fmt_length, data, sizeof( uint32_t ) );
+			memcpy( &tag_length, data + sizeof( uint32_t ), sizeof( uint32_t ) );
+			const char* text = ( const char* ) ( data + 2 * sizeof( uint32_t ) );
+			formats[ record.format_id ] = { std::string( text, fmt_length ), std::string( text + fmt_length, tag_length ) };
+		} );
+
+		// Format every entry.
+		//
+		std::string out;
+		for_each_record( [ & ] ( const binary_record& record )
+		{
+			if ( record.kind != binary_record_entry )
+				return;
+			auto it = formats.find( record.format_id );
+			if ( it == formats.end() )
+			{
+				out += format::str( "<unknown format %u>\n", record.format_id );
+				return;
+			}
+			format_padding( out, record.pad_by, record.padding_bar );
+			format_entry( out, it->second.first, it->second.second, ( const uint8_t* ) ( &record + 1 ) );
+		} );
+
+		if ( uint64_t dropped = header->dropped.load() )
+			out += format::str( "<%llu entries dropped>\n", dropped );
+		return out;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,198 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <atomic>
+#include <type_traits>
+#include "async_logger.hpp"
+
+// Binary logs skip formatting entirely on the hot path, each entry is recorded as
+// the identifier of its format string followed by the raw argument bytes into a
+// memory-mapped file which can be later decoded into text offline.
+// - Format strings and the type signatures of their arguments are recorded the
+//   first time they are used so that the file is self-describing.
+//
+namespace vtil::logger
+{
+	// Header at the beginning of the binary log file.
+	//
+	struct binary_log_header
+	{
+		static constexpr char expected_magic[ 8 ] = { 'V', 'T', 'I', 'L', 'B', 'L', 'O', 'G' };
+		static constexpr uint32_t current_version = 1;
+
+		char magic[ 8 ];
+		uint32_t version;
+		uint32_t wchar_size;
+		uint64_t capacity;
+
+		// Offset of the next record, can be larger than the capacity if records were dropped.
+		//
+		std::atomic<uint64_t> write_offset;
+
+		// Number of entries dropped due to lack of space.
+		//
+		std::atomic<uint64_t> dropped;
+	};
+	static_assert( std::atomic<uint64_t>::is_always_lock_free, "Binary log requires lock-free 64-bit atomics." );
+
+	// Kinds of records in the binary log.
+	//
+	enum binary_record_kind : uint16_t
+	{
+		// Record is reserved but not completely written yet.
+		//
+		binary_record_pending = 0,
+
+		// Defines a format string followed by [uint32_t fmt_length][uint32_t tag_length][fmt][tags].
+		//
+		binary_record_format = 1,
+
+		// Log entry followed by the serialized arguments.
+		//
+		binary_record_entry = 2,
+	};
+
+	// Header of each record, records are aligned to 8 bytes.
+	//
+	struct binary_record
+	{
+		uint32_t size;
+		std::atomic<uint16_t> kind;
+		uint16_t color;
+		uint32_t format_id;
+		uint16_t pad_by;
+		uint8_t padding_bar;
+		uint8_t reserved;
+	};
+	static constexpr size_t binary_record_alignment = 8;
+
+	// Opens a binary log at the given path with the given capacity, while the binary log
+	// is open log entries are recorded into it instead of being written to the console,
+	// warnings and errors are written to both.
+	// - Opening or closing the log must not race with threads that are logging.
+	//
+	bool open_binary_log( const std::string& path, size_t capacity = 64 * 1024 * 1024 );
+	void close_binary_log();
+
+	// Decodes the binary log file at the given path back into text.
+	//
+	std::string decode_binary_log( const std::string& path );
+
+	// Implementation details.
+	//
+	namespace impl
+	{
+		// Type tags of the arguments as recorded in the format definition:
+		//  - c/C, h/H, i/I, l/L: Signed/unsigned integers of 1, 2, 4 and 8 bytes.
+		//  - f/d: float and double.
+		//  - p: Pointer.
+		//  - s/S: Narrow and wide strings.
+		// Types without a tag are formatted on the calling thread instead.
+		//
+		template<typename T>
+		static constexpr char binary_tag()
+		{
+			using U = std::remove_cvref_t<T>;
+			if constexpr ( is_narrow_string_v<T> )
+				return 's';
+			else if constexpr ( is_wide_string_v<T> )
+				return 'S';
+			else if constexpr ( std::is_enum_v<U> )
+				return binary_tag<std::underlying_type_t<U>>();
+			else if constexpr ( std::is_pointer_v<U> )
+				return 'p';
+			else if constexpr ( std::is_same_v<U, float> )
+				return 'f';
+			else if constexpr ( std::is_same_v<U, double> )
+				return 'd';
+			else if constexpr ( std::is_integral_v<U> && sizeof( U ) <= 8 )
+				return ( std::is_signed_v<U> ? "?ch?i???l" : "?CH?I???L" )[ sizeof( U ) ];
+			else
+				return 0;
+		}
+		template<typename... params>
+		static constexpr char binary_tags[] = { binary_tag<params>()..., '\0' };
+
+		// Returns the header of the binary log if it is open, nullptr otherwise.
+		//
+		binary_log_header* binary_sink();
+
+		// Returns the identifier of the format string with the given argument tags,
+		// recording the definition if it was not used before.
+		//
+		uint32_t binary_format_id( binary_log_header* log, const char* fmt, const char* tags );
+
+		// Reserves a record of the given size, returns nullptr if the log is full.
+		//
+		__forceinline static binary_record* binary_reserve( binary_log_header* log, size_t size )
+		{
+			size = ( size + binary_record_alignment - 1 ) & ~( binary_record_alignment - 1 );
+			uint64_t offset = log->write_offset.fetch_add( size, std::memory_order_relaxed );
+			if ( offset + size > log->capacity )
+			{
+				log->dropped.fetch_add( 1, std::memory_order_relaxed );
+				return nullptr;
+			}
+			binary_record* record = ( binary_record* ) ( ( uint8_t* ) log + offset );
+			record->size = ( uint32_t ) size;
+			return record;
+		}
+
+		// Writes a log entry into the binary log.
+		//
+		template<typename... params>
+		static void write_binary( binary_log_header* log, uint16_t color, uint16_t pad_by, bool padding_bar, const char* fmt, const params&... ps )
+		{
+			// If any of the arguments cannot be recorded as is, format on the current thread.
+			//
+			if constexpr ( ( ( binary_tag<params>() == 0 ) || ... ) )
+			{
+				std::string text = format::str( fmt, ps... );
+				write_binary( log, color, pad_by, padding_bar, "%s", text.c_str() );
+			}
+			else
+			{
+				uint32_t format_id = binary_format_id( log, fmt, binary_tags<params...> );
+				size_t size = sizeof( binary_record ) + ( serialized_size( ps ) + ... + 0 );
+				if ( binary_record* record = binary_reserve( log, size ) )
+				{
+					record->color = color;
+					record->format_id = format_id;
+					record->pad_by = pad_by;
+					record->padding_bar = padding_bar;
+
+					uint8_t* it = ( uint8_t* ) ( record + 1 );
+					( serialize( it, ps ), ... );
+					record->kind.store( binary_record_entry, std::memory_order_release );
+				}
+			}
+		}
+	};
+};
\ No newline at end of file
@@ -27,6 +27,9 @@
 //
 #pragma once
 #include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdio>
 #include <type_traits>
 
 #define FMT_TEMP_REG	"t%d"
@@ -46,26 +49,37 @@ namespace vtil::format
 	//
 	static constexpr char suffix_map[] = { ' ', 'b', 'w', ' ', 'd', ' ', ' ', ' ', 'q' };
 
-	// Used to fix std::string usage in combination with "%s".
+	// Used to fix std::string usage in combination with "%s", any other
+	// string-like type exposing ::c_str() (e.g. interned strings) is also converted.
 	//
 	template<typename T>
 	__forceinline static auto fix_parameter( T&& x )
 	{
 		if constexpr ( std::is_same_v<std::remove_cvref_t<T>, std::string> || std::is_same_v<std::remove_cvref_t<T>, std::wstring> )
 			return x.data();
+		else if constexpr ( requires { x.c_str(); } )
+			return x.c_str();
 		else
 			return std::forward<T>( x );
 	}
 
 	// Returns formatted string according to <fms>.
+	// - Formats into a stack buffer first and only formats a second time
+	//   if the result does not fit in it.
 	//
 	template<typename... params>
 	static std::string str( const char* fmt, params&&... ps )
 	{
-		std::string buffer;
-		buffer.resize( snprintf( nullptr, 0, fmt, fix_parameter<params>( std::forward<params>( ps ) )... ) );
-		sprintf_s( buffer.data(), buffer.size() + 1, fmt, fix_parameter<params>( std::forward<params>( ps ) )... );
-		return buffer;
+		char buffer[ 256 ];
+		int length = snprintf( buffer, sizeof( buffer ), fmt, fix_parameter( ps )... );
+		if ( length < 0 )
+			return {};
+		if ( size_t( length ) < sizeof( buffer ) )
+			return std::string( buffer, length );
+
+		std::string result( length, '\0' );
+		snprintf( result.data(), result.size() + 1, fmt, fix_parameter( ps )... );
+		return result;
 	}
 
 	// Formats the integer into a signed hexadecimal.
@@ -88,4 +102,385 @@ namespace vtil::format
 		else
 			return str( "- 0x%llx", -value );
 	}
+
+	// Output buffer of the typed formatter, characters are written into the inline
+	// storage and only spilled to the heap if the result does not fit in it.
+	//
+	struct output_buffer
+	{
+		char inline_data[ 256 ];
+		size_t inline_length = 0;
+		std::string spilled;
+		bool is_spilled = false;
+
+		// Appends characters to the buffer.
+		//
+		void append( const char* data, size_t n )
+		{
+			if ( !is_spilled && ( inline_length + n ) <= sizeof( inline_data ) )
+			{
+				memcpy( inline_data + inline_length, data, n );
+				inline_length += n;
+				return;
+			}
+			spill().append( data, n );
+		}
+		void append( size_t n, char c )
+		{
+			if ( !is_spilled && ( inline_length + n ) <= sizeof( inline_data ) )
+			{
+				memset( inline_data + inline_length, c, n );
+				inline_length += n;
+				return;
+			}
+			spill().append( n, c );
+		}
+		void append( std::string_view str ) { append( str.data(), str.size() ); }
+		void push_back( char c ) { append( &c, 1 ); }
+
+		// Moves the contents to the heap.
+		//
+		std::string& spill()
+		{
+			if ( !is_spilled )
+			{
+				spilled.reserve( inline_length * 2 );
+				spilled.assign( inline_data, inline_length );
+				is_spilled = true;
+			}
+			return spilled;
+		}
+
+		// Accessors for the result.
+		//
+		std::string_view view() const { return is_spilled ? std::string_view{ spilled } : std::string_view{ inline_data, inline_length }; }
+		std::string to_string() { return is_spilled ? std::move( spilled ) : std::string( inline_data, inline_length ); }
+	};
+
+	// Customization point of the typed formatter, types can be made formattable with "%s"
+	// by specializing this with a static write( output_buffer&, const T& ) function.
+	//
+	template<typename T>
+	struct formatter {};
+
+	// Implementation details of the typed formatter.
+	//
+	namespace impl
+	{
+		// Parsed conversion specification, subset of the printf syntax:
+		//   %[-0#+ ][width][length modifiers]{d,i,u,x,X,c,s,p}
+		// - Length modifiers are accepted for compatibility but are ignored as
+		//   the width of integers is taken from the type of the argument.
+		//
+		struct format_spec
+		{
+			bool left_align = false;
+			bool zero_pad = false;
+			bool alternate = false;
+			bool plus_sign = false;
+			uint32_t width = 0;
+			char conversion = 0;
+		};
+
+		// Parses the specification following '%', returns the pointer past
+		// the conversion character or nullptr if it is not supported.
+		//
+		static constexpr const char* parse_spec( const char* it, format_spec& spec )
+		{
+			for ( bool flags = true; flags; )
+			{
+				switch ( *it )
+				{
+					case '-': spec.left_align = true; it++; break;
+					case '0': spec.zero_pad = true;   it++; break;
+					case '#': spec.alternate = true;  it++; break;
+					case '+': spec.plus_sign = true;  it++; break;
+					default:  flags = false;                break;
+				}
+			}
+			while ( '0' <= *it && *it <= '9' )
+				spec.width = spec.width * 10 + ( *it++ - '0' );
+			while ( *it == 'h' || *it == 'l' || *it == 'z' || *it == 'j' || *it == 't' )
+				it++;
+
+			switch ( *it )
+			{
+				case 'd': case 'i': case 'u': case 'x': case 'X': case 'c': case 's': case 'p':
+					spec.conversion = *it;
+					return it + 1;
+				default:
+					return nullptr;
+			}
+		}
+
+		// Categories of the arguments.
+		//
+		enum class arg_kind
+		{
+			integer,
+			string,
+			pointer,
+			custom,
+			unsupported,
+		};
+		template<typename T>
+		static constexpr arg_kind kind_of()
+		{
+			using U = std::remove_cvref_t<T>;
+			if constexpr ( requires( output_buffer& out, const U& value ) { formatter<U>::write( out, value ); } )
+				return arg_kind::custom;
+			else if constexpr ( std::is_integral_v<U> || std::is_enum_v<U> )
+				return arg_kind::integer;
+			else if constexpr ( std::is_convertible_v<const U&, std::string_view> || requires( const U& value ) { value.c_str(); } )
+				return arg_kind::string;
+			else if constexpr ( std::is_pointer_v<U> )
+				return arg_kind::pointer;
+			else if constexpr ( requires( const U& value ) { value.to_string(); } )
+				return arg_kind::custom;
+			else
+				return arg_kind::unsupported;
+		}
+
+		// Checks whether the argument kind can be formatted with the given conversion.
+		//
+		static constexpr bool is_compatible( char conversion, arg_kind kind )
+		{
+			switch ( conversion )
+			{
+				case 'd': case 'i': case 'u': case 'x': case 'X': case 'c':
+					return kind == arg_kind::integer;
+				case 's':
+					return kind == arg_kind::string || kind == arg_kind::custom;
+				case 'p':
+					return kind == arg_kind::pointer || kind == arg_kind::integer;
+				default:
+					return false;
+			}
+		}
+
+		// Not a constant expression, invoked to fail the compilation with the message in the diagnostic.
+		//
+		inline void format_error( [[maybe_unused]] const char* message ) {}
+
+		// Validates the format string against the argument types.
+		//
+		template<typename... params>
+		consteval void validate_format( const char* fmt )
+		{
+			constexpr arg_kind kinds[] = { kind_of<params>()..., arg_kind::unsupported };
+			size_t index = 0;
+			for ( const char* it = fmt; *it; )
+			{
+				if ( *it++ != '%' )
+					continue;
+				if ( *it == '%' )
+				{
+					it++;
+					continue;
+				}
+
+				format_spec spec = {};
+				it = parse_spec( it, spec );
+				if ( !it )
+					return format_error( "Invalid or unsupported conversion specification." );
+				if ( index == sizeof...( params ) )
+					return format_error( "Too few arguments for the format string." );
+				if ( !is_compatible( spec.conversion, kinds[ index++ ] ) )
+					return format_error( "Argument type does not match the conversion specification." );
+			}
+			if ( index != sizeof...( params ) )
+				format_error( "Too many arguments for the format string." );
+		}
+
+		// Writes the body padded according to the specification.
+		//
+		static void write_padded( output_buffer& out, const format_spec& spec, std::string_view prefix, std::string_view body )
+		{
+			size_t length = prefix.size() + body.size();
+			size_t padding = spec.width > length ? spec.width - length : 0;
+			if ( spec.left_align )
+			{
+				out.append( prefix );
+				out.append( body );
+				out.append( padding, ' ' );
+			}
+			else if ( spec.zero_pad )
+			{
+				out.append( prefix );
+				out.append( padding, '0' );
+				out.append( body );
+			}
+			else
+			{
+				out.append( padding, ' ' );
+				out.append( prefix );
+				out.append( body );
+			}
+		}
+
+		// Writes an integer in the given base.
+		//
+		static void write_integer( output_buffer& out, const format_spec& spec, uint64_t magnitude, bool negative, bool hex, bool upper, bool force_prefix )
+		{
+			const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+			char buffer[ 24 ];
+			char* end = buffer + sizeof( buffer );
+			char* it = end;
+			do
+			{
+				*--it = digits[ hex ? ( magnitude & 0xF ) : ( magnitude % 10 ) ];
+				magnitude = hex ? ( magnitude >> 4 ) : ( magnitude / 10 );
+			}
+			while ( magnitude );
+
+			char prefix[ 3 ] = {};
+			size_t prefix_length = 0;
+			if ( negative )
+				prefix[ prefix_length++ ] = '-';
+			else if ( spec.plus_sign && !hex )
+				prefix[ prefix_length++ ] = '+';
+			if ( hex && ( spec.alternate || force_prefix ) )
+			{
+				prefix[ prefix_length++ ] = '0';
+				prefix[ prefix_length++ ] = upper ? 'X' : 'x';
+			}
+			write_padded( out, spec, { prefix, prefix_length }, { it, size_t( end - it ) } );
+		}
+
+		// Writes a single argument according to the specification.
+		//
+		template<typename T>
+		static void write_argument( output_buffer& out, const format_spec& spec, const void* ptr )
+		{
+			using U = std::remove_cvref_t<T>;
+			const U& value = *( const U* ) ptr;
+
+			if constexpr ( kind_of<T>() == arg_kind::custom )
+			{
+				// Use the formatter if specialized, otherwise convert to a string.
+				//
+				if constexpr ( requires( output_buffer& out, const U& value ) { formatter<U>::write( out, value ); } )
+				{
+					if ( !spec.width )
+						return formatter<U>::write( out, value );
+					output_buffer tmp;
+					formatter<U>::write( tmp, value );
+					write_padded( out, spec, {}, tmp.view() );
+				}
+				else
+				{
+					write_padded( out, spec, {}, value.to_string() );
+				}
+			}
+			else if constexpr ( kind_of<T>() == arg_kind::integer )
+			{
+				// Convert enums to the underlying type.
+				//
+				using V = typename std::conditional_t<std::is_enum_v<U>, std::underlying_type<U>, std::type_identity<U>>::type;
+				using UV = std::make_unsigned_t<std::conditional_t<std::is_same_v<V, bool>, uint8_t, V>>;
+				V integer = ( V ) value;
+
+				switch ( spec.conversion )
+				{
+					case 'c':
+					{
+						char c = ( char ) integer;
+						return write_padded( out, spec, {}, { &c, 1 } );
+					}
+					case 'd':
+					case 'i':
+						if constexpr ( std::is_signed_v<V> )
+						{
+							if ( integer < 0 )
+								return write_integer( out, spec, 0ull - ( uint64_t ) ( int64_t ) integer, true, false, false, false );
+						}
+						return write_integer( out, spec, ( uint64_t ) ( UV ) integer, false, false, false, false );
+					case 'u':
+						return write_integer( out, spec, ( uint64_t ) ( UV ) integer, false, false, false, false );
+					case 'p':
+						return write_integer( out, spec, ( uint64_t ) ( UV ) integer, false, true, false, true );
+					default:
+						return write_integer( out, spec, ( uint64_t ) ( UV ) integer, false, true, spec.conversion == 'X', false );
+				}
+			}
+			else if constexpr ( kind_of<T>() == arg_kind::string )
+			{
+				std::string_view view;
+				if constexpr ( requires { value.c_str(); } )
+					view = value.c_str();
+				else if constexpr ( std::is_pointer_v<U> )
+					view = value ? std::string_view{ value } : std::string_view{ "(null)" };
+				else
+					view = value;
+				write_padded( out, spec, {}, view );
+			}
+			else if constexpr ( kind_of<T>() == arg_kind::pointer )
+			{
+				write_integer( out, spec, ( uint64_t ) ( uintptr_t ) value, false, true, false, true );
+			}
+		}
+	};
+
+	// Format string that is validated at compile time against the argument types.
+	//
+	template<typename... params>
+	struct typed_format
+	{
+		const char* fmt;
+		consteval typed_format( const char* fmt ) : fmt( fmt ) { impl::validate_format<params...>( fmt ); }
+	};
+
+	// Formats into the output buffer according to the compile-time validated format string,
+	// in a single pass and without allocating unless the result exceeds the inline buffer.
+	// - Integers are formatted according to their own type with %d/%i/%u/%x/%X/%c/%p.
+	// - Strings, types with a formatter and types with ::to_string() are formatted with %s.
+	//
+	template<typename... params>
+	static void typed_format_to( output_buffer& out, typed_format<std::type_identity_t<params>...> fmt, const params&... ps )
+	{
+		using fn_writer = void( * )( output_buffer&, const impl::format_spec&, const void* );
+		static constexpr fn_writer writers[] = { &impl::write_argument<params>..., nullptr };
+		const void* arguments[] = { &ps..., nullptr };
+
+		size_t index = 0;
+		const char* literal = fmt.fmt;
+		const char* it = fmt.fmt;
+		while ( *it )
+		{
+			if ( *it != '%' )
+			{
+				it++;
+				continue;
+			}
+			out.append( literal, it - literal );
+
+			// Escaped percent sign.
+			//
+			if ( *++it == '%' )
+			{
+				out.push_back( '%' );
+				literal = ++it;
+				continue;
+			}
+
+			// Already validated so no need to check for errors.
+			//
+			impl::format_spec spec = {};
+			it = impl::parse_spec( it, spec );
+			writers[ index ]( out, spec, arguments[ index ] );
+			index++;
+			literal = it;
+		}
+		out.append( literal, it - literal );
+	}
+
+	// Returns the string formatted according to the compile-time validated format string.
+	//
+	template<typename... params>
+	static std::string typed_str( typed_format<std::type_identity_t<params>...> fmt, const params&... ps )
+	{
+		output_buffer out;
+		typed_format_to( out, fmt, ps... );
+		return out.to_string();
+	}
 };
\ No newline at end of file
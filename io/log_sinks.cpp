@@ -0,0 +1,233 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#include "log_sinks.hpp"
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+
+namespace vtil::logger
+{
+	// List of sinks, intentionally leaked as threads may log after static destruction.
+	//
+	static std::vector<std::shared_ptr<log_sink>>& get_sinks()
+	{
+		static auto* sinks = new std::vector<std::shared_ptr<log_sink>>{ default_sink() };
+		return *sinks;
+	}
+
+	// Writes to the standard output.
+	//
+	void stdout_sink::write( console_color color, std::string_view text )
+	{
+		impl::initialize();
+		if ( color != CON_DEF )
+			impl::set_color( color );
+		fwrite( text.data(), 1, text.size(), stdout );
+		if ( color != CON_DEF )
+			impl::set_color( CON_DEF );
+	}
+	void stdout_sink::flush()
+	{
+		fflush( stdout );
+	}
+
+	// Writes to a file.
+	//
+	file_sink::file_sink( const std::string& path, bool append )
+	{
+		file = fopen( path.c_str(), append ? "ab" : "wb" );
+	}
+	file_sink::~file_sink()
+	{
+		if ( file )
+			fclose( file );
+	}
+	void file_sink::write( console_color, std::string_view text )
+	{
+		if ( file )
+			fwrite( text.data(), 1, text.size(), file );
+	}
+	void file_sink::flush()
+	{
+		if ( file )
+			fflush( file );
+	}
+
+	// Captures the output in memory.
+	//
+	std::string memory_sink::take()
+	{
+		std::lock_guard g( log_cs );
+		return std::exchange( buffer, std::string{} );
+	}
+	void memory_sink::write( console_color, std::string_view text )
+	{
+		buffer += text;
+	}
+
+	// Maps the ring file, continuing the existing one if it is valid.
+	//
+	ring_file_sink::ring_file_sink( const std::string& path, size_t capacity )
+	{
+		if ( !capacity )
+			return;
+
+		auto is_valid = [ & ] ()
+		{
+			header* existing = ( header* ) file.base;
+			return file.size == ( sizeof( header ) + capacity ) &&
+				!memcmp( existing->magic, header::expected_magic, sizeof( existing->magic ) ) &&
+				existing->capacity == capacity;
+		};
+
+		if ( !file.open( path, true ) || !is_valid() )
+		{
+			if ( !file.create( path, sizeof( header ) + capacity ) )
+				return;
+			header* created = ( header* ) file.base;
+			memcpy( created->magic, header::expected_magic, sizeof( created->magic ) );
+			created->capacity = capacity;
+			created->position = 0;
+		}
+		hdr = ( header* ) file.base;
+		data = file.base + sizeof( header );
+	}
+
+	// Copies the text into the ring, wrapping around if necessary, the position
+	// is only advanced once the data is written.
+	//
+	void ring_file_sink::write( console_color, std::string_view text )
+	{
+		if ( !hdr )
+			return;
+
+		size_t capacity = hdr->capacity;
+		uint64_t position = hdr->position.load( std::memory_order_relaxed );
+
+		// If the text is larger than the ring, only keep the tail.
+		//
+		if ( text.size() > capacity )
+		{
+			position += text.size() - capacity;
+			text.remove_prefix( text.size() - capacity );
+		}
+
+		size_t offset = position % capacity;
+		size_t first = std::min( text.size(), capacity - offset );
+		memcpy( data + offset, text.data(), first );
+		memcpy( data, text.data() + first, text.size() - first );
+		hdr->position.store( position + text.size(), std::memory_order_release );
+	}
+	void ring_file_sink::sync()
+	{
+		file.flush();
+	}
+
+	// Reads the contents of the ring file in order.
+	//
+	std::string ring_file_sink::read( const std::string& path )
+	{
+		mapped_file file;
+		if ( !file.open( path ) || file.size < sizeof( header ) )
+			return {};
+		const header* hdr = ( const header* ) file.base;
+		if ( memcmp( hdr->magic, header::expected_magic, sizeof( hdr->magic ) ) || !hdr->capacity || file.size != ( sizeof( header ) + hdr->capacity ) )
+			return {};
+
+		const char* data = ( const char* ) ( file.base + sizeof( header ) );
+		uint64_t position = hdr->position.load();
+		if ( position <= hdr->capacity )
+			return std::string( data, position );
+
+		size_t offset = position % hdr->capacity;
+		std::string out;
+		out.reserve( hdr->capacity );
+		out.append( data + offset, hdr->capacity - offset );
+		out.append( data, offset );
+		size_t line_end = out.find( '\n' );
+		out.erase( 0, line_end == std::string::npos ? 0 : line_end + 1 );
+		return out;
+	}
+
+	// Adds or removes a sink.
+	//
+	void add_sink( std::shared_ptr<log_sink> sink )
+	{
+		std::lock_guard g( log_cs );
+		get_sinks().emplace_back( std::move( sink ) );
+	}
+	void remove_sink( const std::shared_ptr<log_sink>& sink )
+	{
+		std::lock_guard g( log_cs );
+		auto& sinks = get_sinks();
+		sinks.erase( std::remove( sinks.begin(), sinks.end(), sink ), sinks.end() );
+	}
+
+	// Removes every sink, including the default one.
+	//
+	void clear_sinks()
+	{
+		std::lock_guard g( log_cs );
+		get_sinks().clear();
+	}
+
+	// Returns the default stdout sink.
+	//
+	std::shared_ptr<log_sink> default_sink()
+	{
+		static auto* sink = new std::shared_ptr<log_sink>( std::make_shared<stdout_sink>() );
+		return *sink;
+	}
+
+	// Writes the text to every sink registered, caller must hold log_cs.
+	//
+	void impl::write_sinks( console_color color, std::string_view text )
+	{
+		for ( auto& sink : get_sinks() )
+			sink->write( color, text );
+	}
+
+	// Flushes every sink registered.
+	//
+	void impl::flush_sinks()
+	{
+		std::lock_guard g( log_cs );
+		for ( auto& sink : get_sinks() )
+			sink->flush();
+	}
+
+	// Syncs every sink registered.
+	//
+	void impl::sync_sinks()
+	{
+		std::lock_guard g( log_cs );
+		for ( auto& sink : get_sinks() )
+			sink->sync();
+	}
+};
\ No newline at end of file
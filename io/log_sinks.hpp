@@ -0,0 +1,167 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <atomic>
+#include <cstdio>
+#include "logger.hpp"
+#include "..\util\mapped_file.hpp"
+
+namespace vtil::logger
+{
+	// Interface of the log outputs, complete lines are written to every sink registered
+	// while holding log_cs so implementations do not need to synchronize writes.
+	//
+	struct log_sink
+	{
+		virtual ~log_sink() = default;
+
+		// Writes the text, a line may be written in multiple calls if it has multiple colors.
+		//
+		virtual void write( console_color color, std::string_view text ) = 0;
+
+		// Flushes any data buffered.
+		//
+		virtual void flush() {}
+
+		// Flushes and writes the data through to the storage, invoked before the 
+		// process is terminated or when explicitly requested.
+		//
+		virtual void sync() { flush(); }
+	};
+
+	// Writes to the standard output, the default sink.
+	//
+	struct stdout_sink : log_sink
+	{
+		void write( console_color color, std::string_view text ) override;
+		void flush() override;
+	};
+
+	// Writes to a file.
+	//
+	struct file_sink : log_sink
+	{
+		FILE* file = nullptr;
+
+		file_sink( const std::string& path, bool append = true );
+		~file_sink();
+
+		bool is_open() const { return file != nullptr; }
+		void write( console_color color, std::string_view text ) override;
+		void flush() override;
+	};
+
+	// Captures the output in memory.
+	//
+	struct memory_sink : log_sink
+	{
+		std::string buffer;
+
+		// Returns the text captured so far and clears it.
+		//
+		std::string take();
+
+		void write( console_color color, std::string_view text ) override;
+	};
+
+	// Writes to a fixed-size memory-mapped file that wraps around once full, keeping
+	// the most recent output with bounded disk usage. As the file is shared with the
+	// mapping, the contents persist even if the process crashes.
+	// - An existing file with the same capacity is continued instead of truncated.
+	// - Flushing is a no-op as the pages are already shared with the file, they are 
+	//   only written through to the storage on sync or when the sink is destroyed.
+	// - A capacity of zero is rejected, leaving the sink closed.
+	//
+	struct ring_file_sink : log_sink
+	{
+		// Header at the beginning of the file, followed by the data.
+		//
+		struct header
+		{
+			static constexpr char expected_magic[ 8 ] = { 'V', 'T', 'I', 'L', 'R', 'I', 'N', 'G' };
+
+			char magic[ 8 ];
+			uint64_t capacity;
+
+			// Total number of bytes written, the data ends at position % capacity.
+			//
+			std::atomic<uint64_t> position;
+			uint8_t reserved[ 40 ];
+		};
+		static_assert( sizeof( header ) == 64, "Ring file header must be 64 bytes." );
+
+		mapped_file file;
+		header* hdr = nullptr;
+		uint8_t* data = nullptr;
+
+		ring_file_sink( const std::string& path, size_t capacity = 16 * 1024 * 1024 );
+
+		bool is_open() const { return hdr != nullptr; }
+		void write( console_color color, std::string_view text ) override;
+		void sync() override;
+
+		// Reads the contents of the ring file at the given path in order, dropping the
+		// partially overwritten line at the beginning if the ring has wrapped around.
+		//
+		static std::string read( const std::string& path );
+	};
+
+	// Adds or removes a sink, by default only an instance of stdout_sink is registered.
+	//
+	void add_sink( std::shared_ptr<log_sink> sink );
+	void remove_sink( const std::shared_ptr<log_sink>& sink );
+
+	// Removes every sink, including the default one.
+	//
+	void clear_sinks();
+
+	// Returns the default stdout sink so that it can be registered again after being removed.
+	//
+	std::shared_ptr<log_sink> default_sink();
+
+	// Implementation details.
+	//
+	namespace impl
+	{
+		// Writes the text to every sink registered, caller must hold log_cs.
+		//
+		void write_sinks( console_color color, std::string_view text );
+
+		// Flushes every sink registered.
+		//
+		void flush_sinks();
+
+		// Syncs every sink registered.
+		//
+		void sync_sinks();
+	};
+};
\ No newline at end of file
@@ -26,6 +26,13 @@
 // POSSIBILITY OF SUCH DAMAGE.        
 //
 #include "logger.hpp"
+#include "log_sinks.hpp"
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "..\util\thread_registry.hpp"
 
 #if _WIN64
 	#define WIN32_LEAN_AND_MEAN
@@ -55,4 +62,381 @@ namespace vtil::logger::impl
 #endif
 		log_init = true;
 	}
+
+	// Appends the padding prefix of a line.
+	//
+	void format_padding( std::string& out, int pad_by, bool padding_bar )
+	{
+		for ( int i = 0; i < pad_by; i++ )
+		{
+			out.append( log_padding_step - 1, ' ' );
+			if ( ( i + 1 ) != pad_by || padding_bar )
+				out += log_padding_c;
+		}
+	}
+
+	// Output assembled before being written, split into segments of the same color.
+	//
+	struct output_batch
+	{
+		std::vector<std::pair<uint16_t, std::string>> segments;
+
+		// Returns the segment to append to for the given color.
+		//
+		std::string& at( uint16_t color )
+		{
+#if !_WIN64
+			// Colors are not used, so write everything as a single segment.
+			//
+			color = CON_DEF;
+#endif
+			if ( segments.empty() || segments.back().first != color )
+				segments.emplace_back( color, std::string{} );
+			return segments.back().second;
+		}
+	};
+
+	// Whether or not the current thread is formatting records, in which case an
+	// error raised by the formatter must not drain the buffers again.
+	//
+	static thread_local bool is_draining = false;
+
+	// Formats every record pending in the ring buffer into the batch, the caller must 
+	// hold log_cs as it is the only consumer lock of the buffers.
+	//
+	static void drain( log_ring& ring, output_batch& batch )
+	{
+		is_draining = true;
+		ring.consume( [ & ] ( const record_header& header, const uint8_t* data )
+		{
+			if ( header.pad_by )
+				format_padding( batch.at( CON_DEF ), header.pad_by, header.padding_bar );
+			const char* fmt = ( const char* ) data;
+			header.formatter( fmt, data + header.fmt_size, batch.at( header.color ) );
+		} );
+		is_draining = false;
+	}
+
+	// Writes the batch to the sinks while holding the output lock.
+	//
+	static void write_batch( output_batch& batch )
+	{
+		if ( batch.segments.empty() )
+			return;
+
+		std::lock_guard g( log_cs );
+		for ( auto& [color, text] : batch.segments )
+			write_sinks( ( console_color ) color, text );
+		batch.segments.clear();
+	}
+
+	// Line buffer of the current thread, an incomplete line is written as the thread exits.
+	//
+	struct line_buffer
+	{
+		output_batch line;
+		~line_buffer() { write_batch( line ); }
+	};
+	static thread_local line_buffer local_line;
+
+	// Appends the padding and the text to the line buffer of the current thread, 
+	// writes the line to the output if the text ends with a new-line.
+	//
+	int write_line( console_color color, int pad_by, bool padding_bar, const std::string& text )
+	{
+		output_batch& line = local_line.line;
+		int count = ( int ) text.size();
+		if ( pad_by )
+		{
+			std::string& out = line.at( CON_DEF );
+			size_t prev_size = out.size();
+			format_padding( out, pad_by, padding_bar );
+			count += ( int ) ( out.size() - prev_size );
+		}
+		line.at( color ) += text;
+
+		if ( !text.empty() && text.back() == '\n' )
+			write_batch( line );
+		return count;
+	}
+
+	// Registry of the call sites holding back entries, intentionally leaked as
+	// sites may be destroyed after the static objects of this unit.
+	//
+	struct site_registry
+	{
+		std::mutex mutex;
+		std::vector<log_site*> sites;
+	};
+	static site_registry& get_site_registry()
+	{
+		static auto* registry = new site_registry();
+		return *registry;
+	}
+
+	// Appends the reports of the entries held back by every site to the batch.
+	//
+	static void report_sites( output_batch& batch )
+	{
+		site_registry& registry = get_site_registry();
+		std::lock_guard g( registry.mutex );
+		std::string text;
+		for ( log_site* site : registry.sites )
+			if ( site->take_pending( text ) )
+				batch.at( site->color ) += text;
+	}
+
+	// State of the asynchronous logger.
+	//
+	struct async_state
+	{
+		// Whether or not asynchronous logging is enabled.
+		//
+		std::atomic<bool> enabled = false;
+
+		// Ring buffers of each thread, pending entries are written as the thread exits.
+		//
+		per_thread<log_ring> rings{ [ ] ( log_ring& ring )
+		{
+			std::lock_guard g( log_cs );
+			output_batch batch;
+			drain( ring, batch );
+			write_batch( batch );
+		} };
+
+		// Background thread and the event used to wake it up.
+		//
+		std::mutex control_mutex;
+		std::mutex wake_mutex;
+		std::condition_variable wake_event;
+		std::atomic<bool> stop = false;
+		std::thread worker;
+
+		// Stops the background thread on exit.
+		//
+		~async_state() { set_async( false ); }
+	};
+	static async_state async;
+
+	// Writes every pending asynchronous log entry and the incomplete line of the current
+	// thread to the output, followed by the reports of the call sites if requested.
+	//
+	static void write_pending( bool with_sites )
+	{
+		// Hold log_cs until the batch is written so that entries drained by concurrent
+		// flushes are not reordered, the registry lock is acquired first as exiting 
+		// threads drain their buffers while holding it.
+		//
+		vtil::impl::with_registry_lock( [ & ] ()
+		{
+			std::lock_guard g( log_cs );
+			output_batch batch;
+			async.rings.for_each( [ & ] ( log_ring& ring ) { drain( ring, batch ); } );
+			if ( with_sites )
+				report_sites( batch );
+			write_batch( batch );
+			write_batch( local_line.line );
+		} );
+		flush_sinks();
+	}
+
+	// Flushes the buffers periodically or when woken up, the entries held back by the
+	// call sites are left to explicit flushes so that repetitions are not split.
+	//
+	static void async_worker()
+	{
+		std::unique_lock lock( async.wake_mutex );
+		while ( !async.stop )
+		{
+			async.wake_event.wait_for( lock, std::chrono::milliseconds( 10 ) );
+			lock.unlock();
+			write_pending( false );
+			lock.lock();
+		}
+	}
+
+	// Writes the entries pending in the ring buffer of the current thread on the current
+	// thread, skipped if the current thread is already formatting the buffers.
+	//
+	void async_write_local()
+	{
+		if ( is_draining )
+			return;
+		if ( log_ring* ring = async.rings.find() )
+		{
+			std::lock_guard g( log_cs );
+			output_batch batch;
+			drain( *ring, batch );
+			write_batch( batch );
+		}
+	}
+
+	// Returns the ring buffer of the current thread if asynchronous logging is
+	// enabled, nullptr otherwise.
+	//
+	log_ring* async_buffer()
+	{
+		if ( !async.enabled.load( std::memory_order_relaxed ) )
+			return nullptr;
+
+		// If the background thread would block on a lock held by the current thread,
+		// write the pending entries here so that the entry can be logged synchronously.
+		//
+		if ( log_cs.is_owned() || vtil::impl::holds_registry_lock() ) [[unlikely]]
+		{
+			async_write_local();
+			return nullptr;
+		}
+		return &async.rings.local();
+	}
+
+	// Stops the asynchronous logger without waiting for the background thread and 
+	// writes the pending entries on the current thread, used before terminating.
+	//
+	void async_abort()
+	{
+		async.enabled = false;
+		async.stop = true;
+		async.wake_event.notify_all();
+
+		// Detach the background thread unless another thread is changing the state.
+		//
+		if ( async.control_mutex.try_lock() )
+		{
+			if ( async.worker.joinable() )
+				async.worker.detach();
+			async.control_mutex.unlock();
+		}
+
+		abort_flush();
+	}
+
+	// Writes every pending entry without acquiring the registry lock and syncs
+	// the sinks, used before terminating.
+	//
+	void abort_flush()
+	{
+		// Skip the buffers if the error was raised while formatting them.
+		//
+		{
+			std::lock_guard g( log_cs );
+			output_batch batch;
+			if ( !is_draining )
+				async.rings.for_each_unlocked( [ & ] ( log_ring& ring ) { drain( ring, batch ); } );
+			write_batch( batch );
+			write_batch( local_line.line );
+		}
+		sync_sinks();
+	}
+
+	// Wakes up the background thread, invoked when the ring buffer is full.
+	//
+	void async_notify()
+	{
+		// If the background thread is not running, flush on the current thread.
+		//
+		if ( !async.enabled.load( std::memory_order_relaxed ) )
+			return write_pending( false );
+		async.wake_event.notify_one();
+		std::this_thread::yield();
+	}
+};
+
+namespace vtil::logger
+{
+	// Enables or disables asynchronous logging.
+	//
+	void set_async( bool enable )
+	{
+		using namespace impl;
+		std::lock_guard g( async.control_mutex );
+		if ( async.enabled == enable )
+			return;
+
+		if ( enable )
+		{
+			async.stop = false;
+			async.worker = std::thread( async_worker );
+			async.enabled = true;
+		}
+		else
+		{
+			async.enabled = false;
+			{
+				std::lock_guard lock( async.wake_mutex );
+				async.stop = true;
+			}
+			async.wake_event.notify_all();
+
+			// If invoked from the background thread itself (e.g. an error while 
+			// formatting), detach instead of joining.
+			//
+			if ( async.worker.get_id() == std::this_thread::get_id() )
+				async.worker.detach();
+			else
+				async.worker.join();
+			flush();
+		}
+	}
+
+	// Changes the threshold of the category with the given name, or every category 
+	// if the name is empty.
+	//
+	bool set_level( std::string_view category, log_level level )
+	{
+		bool found = false;
+		for ( log_category* it = impl::category_list.load(); it; it = it->next )
+		{
+			if ( category.empty() || category == it->name )
+			{
+				it->threshold = level;
+				found = true;
+			}
+		}
+		return found;
+	}
+
+	// Writes every pending asynchronous log entry, the incomplete line of the
+	// current thread and the entries held back by the call sites to the output.
+	//
+	void flush()
+	{
+		impl::write_pending( true );
+	}
+
+	// Registers the call site.
+	//
+	log_site::log_site( console_color color, const char* pending_fmt ) : color( color ), pending_fmt( pending_fmt )
+	{
+		impl::site_registry& registry = impl::get_site_registry();
+		std::lock_guard g( registry.mutex );
+		registry.sites.push_back( this );
+	}
+
+	// Unregisters the call site and reports the entries it is still holding back.
+	//
+	log_site::~log_site()
+	{
+		{
+			impl::site_registry& registry = impl::get_site_registry();
+			std::lock_guard g( registry.mutex );
+			registry.sites.erase( std::find( registry.sites.begin(), registry.sites.end(), this ) );
+		}
+
+		impl::output_batch batch;
+		std::string text;
+		if ( take_pending( text ) )
+		{
+			batch.at( color ) += text;
+			impl::write_batch( batch );
+		}
+	}
+
+	// Flushes and writes the output through to the storage.
+	//
+	void sync()
+	{
+		flush();
+		impl::sync_sinks();
+	}
 };
\ No newline at end of file
@@ -30,9 +30,15 @@
 #include <stdint.h>
 #include <string>
 #include <mutex>
+#include <atomic>
+#include <optional>
+#include <string_view>
 #include <intrin.h>
 #include "formatting.hpp"
+#include "async_logger.hpp"
+#include "binary_log.hpp"
 #include "..\util\critical_section.hpp"
+#include "..\util\zone_recorder.hpp"
 
 namespace vtil::logger
 {
@@ -50,48 +56,130 @@ namespace vtil::logger
 		CON_DEF = 7,
 	};
 
-	// State of the logging engine.
+	// Lock guarding the output, only held while a complete line is written.
+	// - Recursive, so it can be held to keep multiple lines of a thread together.
 	//
-	static critical_section log_cs;
-	static volatile bool log_disable = false;
+	inline critical_section log_cs;
 
 	// Padding customization for logger.
 	//
 	static constexpr char log_padding_c = '|';
 	static constexpr uint32_t log_padding_step = 2;
 
-	// Current logger padding.
+	// State of the logging engine, local to each thread so that scopes
+	// on different threads do not affect or block each other.
 	//
-	static volatile int log_padding = -1;
-	static volatile int log_padding_carry = 0;
+	inline thread_local bool log_disable = false;
+	inline thread_local int log_padding = -1;
+	inline thread_local int log_padding_carry = 0;
 
-	// RAII hack for incrementing the padding until routine ends.
-	// Can be used with the argument u=0 to act as a lock guard.
-	// - Will wait for the critical section ownership and hold it
-	//   until the scope ends.
+	// RAII hack for incrementing the padding of the current thread until routine ends.
+	// - If a zone name is given and the profiler is enabled, the scope is also recorded
+	//   as a profiler zone so that it appears in the exported traces.
 	//
 	struct scope_padding
 	{
 		int prev = log_padding;
-		bool holds_lock = false;
-		scope_padding( unsigned u ) { log_padding += u; log_cs.lock(); holds_lock = true; }
-		void end() { if ( holds_lock ) log_cs.unlock(), holds_lock = false; log_padding = prev; }
+		bool active = true;
+#if VTIL_PROFILER
+		std::optional<profiler::scope_zone> zone;
+
+		scope_padding( unsigned u, const char* zone_name ) : zone( std::in_place, zone_name ) { log_padding += u; }
+#else
+		scope_padding( unsigned u, const char* ) { log_padding += u; }
+#endif
+		scope_padding( unsigned u ) { log_padding += u; }
+		void end() 
+		{ 
+			if ( !active ) return;
+#if VTIL_PROFILER
+			if ( zone ) zone->end();
+#endif
+			log_padding = prev, active = false;
+		}
 		~scope_padding() { end(); }
 	};
 
-	// RAII hack for changing verbosity of logs within the scope.
-	// - Will wait for the critical section ownership and hold it
-	//   until the scope ends.
+	// RAII hack for changing verbosity of logs of the current thread within the scope.
 	//
 	struct scope_verbosity
 	{
 		bool prev = log_disable;
-		bool holds_lock = false;
-		scope_verbosity( bool verbose_output ) { log_disable |= !verbose_output; log_cs.lock(); holds_lock = true; }
-		void end() { if ( holds_lock ) log_cs.unlock(), holds_lock = false; log_disable = prev; }
+		bool active = true;
+		scope_verbosity( bool verbose_output ) { log_disable |= !verbose_output; }
+		void end() { if ( active ) log_disable = prev, active = false; }
 		~scope_verbosity() { end(); }
 	};
 
+	// Severity levels of log entries.
+	//
+	enum log_level : uint8_t
+	{
+		level_trace,
+		level_debug,
+		level_info,
+		level_warn,
+		level_error,
+		level_none,
+	};
+
+	// Default color of each level.
+	//
+	static constexpr console_color level_color( log_level level )
+	{
+		switch ( level )
+		{
+			case level_warn:  return CON_YLW;
+			case level_error: return CON_RED;
+			case level_trace: return CON_BLU;
+			default:          return CON_DEF;
+		}
+	}
+
+	// Whether entries of the level are written as text even while the binary log is open.
+	//
+	static constexpr bool level_always_text( log_level level )
+	{
+		return level >= level_warn;
+	}
+
+	// Categories of log entries, each with a runtime threshold below which entries
+	// are discarded, categories register themselves on construction so they must
+	// have static storage duration.
+	//
+	struct log_category;
+	namespace impl { inline std::atomic<log_category*> category_list = nullptr; };
+	struct log_category
+	{
+		const char* name;
+		std::atomic<log_level> threshold;
+		log_category* next = nullptr;
+
+		log_category( const char* name, log_level threshold = level_info ) : name( name ), threshold( threshold )
+		{
+			next = impl::category_list.load();
+			while ( !impl::category_list.compare_exchange_weak( next, this ) );
+		}
+		log_category( log_category&& ) = delete;
+		log_category( const log_category& ) = delete;
+
+		// Checks whether entries of the given level should be logged.
+		//
+		__forceinline bool is_enabled( log_level level ) const { return level >= threshold.load( std::memory_order_relaxed ); }
+	};
+
+	// Categories used by the library.
+	//
+	inline log_category category_general{ "general" };
+	inline log_category category_amd64{ "amd64" };
+	inline log_category category_math{ "math" };
+	inline log_category category_query{ "query" };
+
+	// Changes the threshold of the category with the given name, or every category 
+	// if the name is empty. Returns false if there is no such category.
+	//
+	bool set_level( std::string_view category, log_level level );
+
 	// Implementation details.
 	//
 	namespace impl
@@ -103,68 +191,122 @@ namespace vtil::logger
 		// Internally used to initialize the logger.
 		//
 		void initialize();
+
+		// Appends the padding prefix of a line.
+		//
+		void format_padding( std::string& out, int pad_by, bool padding_bar );
+
+		// Appends the padding and the text to the line buffer of the current thread, 
+		// writes the line to the output if the text ends with a new-line. Returns
+		// the number of characters appended.
+		//
+		int write_line( console_color color, int pad_by, bool padding_bar, const std::string& text );
+
+		// Stops the asynchronous logger without waiting for the background thread and 
+		// writes the pending entries on the current thread, used before terminating.
+		//
+		void async_abort();
+
+		// Writes every pending entry without acquiring the registry lock and syncs
+		// the sinks, used before terminating.
+		//
+		void abort_flush();
 	
 		// Used to mark functions noreturn.
 		//
 		__declspec( noreturn ) __forceinline static void noreturn_helper() { __debugbreak(); }
+
+		// Calculates the padding of the next line and updates the carry.
+		//
+		struct padding_info
+		{
+			int pad_by = 0;
+			bool padding_bar = false;
+		};
+		__forceinline static padding_info next_padding( const char* fmt )
+		{
+			padding_info info = {};
+
+			// If we should pad this output:
+			//
+			if ( log_padding > 0 )
+			{
+				// If it was not carried from previous:
+				//
+				info.pad_by = log_padding - log_padding_carry;
+				info.padding_bar = fmt[ 0 ] == ' ';
+
+				// Set or clear the carry for next.
+				//
+				if ( fmt[ strlen( fmt ) - 1 ] == '\n' )
+					log_padding_carry = 0;
+				else
+					log_padding_carry = log_padding;
+			}
+			return info;
+		}
 	};
 
+	// Enables or disables asynchronous logging, when enabled log calls serialize
+	// their arguments into a per-thread buffer and return immediately while a 
+	// background thread formats and writes them in batches.
+	// - Order of the entries is only preserved within each thread.
+	// - Disabling it will stop the background thread and flush any pending entries.
+	//
+	void set_async( bool enable );
+
+	// Writes every pending asynchronous log entry, the incomplete line of the
+	// current thread and the entries held back by the call sites to the output.
+	//
+	void flush();
+
+	// Flushes and writes the output through to the storage, for sinks
+	// that defer it such as memory-mapped files.
+	//
+	void sync();
+
 	// Main function used when logging.
+	// - If [always_text] is set, the entry is written as text even while the binary log
+	//   is open, used for warnings and errors which should not wait to be decoded.
 	//
-	template<console_color color = CON_DEF, typename... params>
+	template<console_color color = CON_DEF, bool always_text = false, typename... params>
 	static int log( const char* fmt, params&&... ps )
 	{
 		// Do not execute if logs are disabled.
 		//
 		if ( log_disable ) return 0;
 
-		// Hold the lock for the critical section guarding ::log.
-		//
-		std::lock_guard g( log_cs );
-
-		// Initialize logger if not done already.
-		//
-		impl::initialize();
-
-		// Set to defualt color.
+		// If the binary log is open, record the entry without formatting it.
 		//
-		impl::set_color( CON_DEF );
-		int out_cnt = 0;
+		if ( logger::binary_log_header* sink = impl::binary_sink() )
+		{
+			auto [pad_by, padding_bar] = impl::next_padding( fmt );
+			impl::write_binary( sink, ( uint16_t ) color, ( uint16_t ) pad_by, padding_bar, fmt, format::fix_parameter( ps )... );
+			if constexpr ( always_text )
+				return impl::write_line( color, pad_by, padding_bar, format::str( fmt, std::forward<params>( ps )... ) );
+			return 0;
+		}
 
-		// If we should pad this output:
+		// If asynchronous logging is enabled, serialize into the buffer of the current thread,
+		// if the arguments cannot be serialized, format them here and buffer the text instead
+		// so that the entry is not written before the ones still in the buffer.
 		//
-		if ( log_padding > 0 )
+		if ( impl::log_ring* ring = impl::async_buffer() )
 		{
-			// If it was not carried from previous:
-			//
-			if( int pad_by = log_padding - log_padding_carry )
-			{
-				for ( int i = 0; i < pad_by; i++ )
-				{
-					if ( ( i + 1 ) == pad_by )
-					{
-						out_cnt += printf( "%*c", log_padding_step - 1, ' ' );
-						if ( fmt[ 0 ] == ' ' ) putchar( log_padding_c );
-					}
-					else
-					{
-						out_cnt += printf( "%*c%c", log_padding_step - 1, ' ', log_padding_c );
-					}
-				}
-			}
-
-			// Set or clear the carry for next.
-			//
-			if ( fmt[ strlen( fmt ) - 1 ] == '\n' )
-				log_padding_carry = 0;
-			else
-				log_padding_carry = log_padding;
+			auto [pad_by, padding_bar] = impl::next_padding( fmt );
+			if ( impl::enqueue( ring, ( uint16_t ) color, ( uint16_t ) pad_by, padding_bar, fmt, format::fix_parameter( ps )... ) )
+				return 0;
+			std::string text = format::str( fmt, std::forward<params>( ps )... );
+			impl::enqueue_text( ring, ( uint16_t ) color, ( uint16_t ) pad_by, padding_bar, text );
+			return ( int ) text.size();
 		}
 
-		// Set to requested color and redirect to printf.
+		// Format on the current thread and append to the line buffer of the thread,
+		// which is written as a whole once the line is complete.
 		//
-		impl::set_color( color );
-		return out_cnt + printf( fmt, format::fix_parameter<params>( std::forward<params>( ps ) )... );
+		auto [pad_by, padding_bar] = impl::next_padding( fmt );
+		std::string text = format::str( fmt, std::forward<params>( ps )... );
+		return impl::write_line( color, pad_by, padding_bar, text );
 	}
 
 	// Prints an error message and breaks the execution.
@@ -176,9 +318,15 @@ namespace vtil::logger
 		//
 		new ( &log_cs ) critical_section();
 
+		// Switch back to synchronous logging and flush any pending entries, the background 
+		// thread is not joined as it may be blocked by the state that caused the error.
+		//
+		impl::async_abort();
+
 		// Print the erorr message.
 		//
-		log<CON_RED>( fmt, std::forward<params>( ps )... );
+		log<CON_RED, true>( fmt, std::forward<params>( ps )... );
+		impl::abort_flush();
 
 		// Break the program.
 		//
@@ -189,4 +337,238 @@ namespace vtil::logger
 #endif
 		impl::noreturn_helper();
 	}
-};
\ No newline at end of file
+
+	// Common state of the call sites holding back entries, the number of entries
+	// held back is reported using the given format string once the site logs again,
+	// on an explicit flush, or when the site is destroyed at exit.
+	// - Sites register themselves on construction so they must have static storage duration.
+	//
+	struct log_site
+	{
+		console_color color;
+		const char* pending_fmt;
+		std::atomic<uint32_t> pending = 0;
+
+		log_site( console_color color, const char* pending_fmt );
+		log_site( log_site&& ) = delete;
+		log_site( const log_site& ) = delete;
+		~log_site();
+
+		// Takes the number of entries held back and formats the report if non-zero.
+		//
+		bool take_pending( std::string& out )
+		{
+			if ( !pending.load( std::memory_order_relaxed ) )
+				return false;
+			uint32_t count = pending.exchange( 0, std::memory_order_relaxed );
+			if ( !count )
+				return false;
+			out = format::str( pending_fmt, count );
+			return true;
+		}
+	};
+
+	// State of a rate-limited call site, a token bucket allowing bursts of [burst] 
+	// entries refilled at [per_second] entries per second.
+	// - Implemented as a virtual scheduling clock: an entry is allowed if the theoretical
+	//   time of its arrival is not further than the burst in the future, which makes the
+	//   check a single load and a compare-exchange on the common path.
+	// - A rate of zero only allows the initial burst.
+	//
+	struct rate_limit_site : log_site
+	{
+		profiler::tsc_t interval;
+		profiler::tsc_t tolerance;
+		std::atomic<profiler::tsc_t> arrival = 0;
+
+		rate_limit_site( uint32_t burst, double per_second, console_color color = CON_DEF ) 
+			: log_site( color, "(%u similar entries suppressed)\n" )
+		{
+			// Without a refill, space the arrivals far enough that the burst is never
+			// replenished while keeping the clock clear of overflows.
+			//
+			if ( per_second > 0 )
+				interval = ( profiler::tsc_t ) ( profiler::ticks_per_second() / per_second );
+			else
+				interval = ( ~0ull >> 2 ) / ( uint64_t( burst ) + 1 );
+			tolerance = interval * ( burst ? burst - 1 : 0 );
+		}
+
+		// Tries to acquire a token, on success returns the number of entries suppressed
+		// since the last successful acquisition.
+		//
+		__forceinline std::optional<uint32_t> acquire()
+		{
+			profiler::tsc_t now = profiler::timestamp();
+			profiler::tsc_t tat = arrival.load( std::memory_order_relaxed );
+			while ( true )
+			{
+				profiler::tsc_t base = tat > now ? tat : now;
+				if ( base - now > tolerance ) [[unlikely]]
+				{
+					pending.fetch_add( 1, std::memory_order_relaxed );
+					return std::nullopt;
+				}
+				if ( arrival.compare_exchange_weak( tat, base + interval, std::memory_order_relaxed ) )
+					break;
+			}
+			return pending.load( std::memory_order_relaxed ) ? pending.exchange( 0, std::memory_order_relaxed ) : 0;
+		}
+	};
+
+	// State of a deduplicated call site, consecutive entries with identical arguments
+	// are dropped and reported as a single line once a different entry is logged.
+	//
+	struct dedup_site : log_site
+	{
+		std::atomic<uint64_t> last_hash = 0;
+
+		dedup_site( console_color color = CON_DEF ) : log_site( color, "(last message repeated %u times)\n" ) {}
+	};
+
+	namespace impl
+	{
+		// Hashes a log entry, the format string and string arguments are hashed by their
+		// contents and any other argument by its bytes.
+		//
+		__forceinline static void hash_bytes( uint64_t& hash, const void* data, size_t length )
+		{
+			for ( size_t i = 0; i != length; i++ )
+				hash = ( hash ^ ( ( const uint8_t* ) data )[ i ] ) * 0x100000001B3;
+		}
+		template<typename T>
+		__forceinline static void hash_argument( uint64_t& hash, const T& value )
+		{
+			if constexpr ( is_narrow_string_v<T> )
+			{
+				std::string_view view = to_narrow_view( value );
+				hash_bytes( hash, view.data(), view.size() );
+			}
+			else if constexpr ( is_wide_string_v<T> )
+			{
+				std::wstring_view view = to_wide_view( value );
+				hash_bytes( hash, view.data(), view.size() * sizeof( wchar_t ) );
+			}
+			else
+			{
+				hash_bytes( hash, &value, sizeof( T ) );
+			}
+			hash_bytes( hash, "", 1 );
+		}
+		template<typename... params>
+		static uint64_t hash_entry( const char* fmt, const params&... ps )
+		{
+			uint64_t hash = 0xCBF29CE484222325;
+			hash_bytes( hash, fmt, strlen( fmt ) + 1 );
+
+			// If any of the arguments has no byte representation, hash the formatted entry instead.
+			//
+			if constexpr ( ( is_serializable_v<params> && ... ) )
+			{
+				( hash_argument( hash, ps ), ... );
+			}
+			else
+			{
+				std::string text = format::str( fmt, ps... );
+				hash_bytes( hash, text.data(), text.size() );
+			}
+			return hash | 1;
+		}
+	};
+
+	// Logs the entry if the rate limit of the call site allows it, reporting the 
+	// number of entries suppressed in between.
+	//
+	template<console_color color = CON_DEF, bool always_text = false, typename... params>
+	static int log_limited( rate_limit_site& site, const char* fmt, params&&... ps )
+	{
+		std::optional<uint32_t> suppressed = site.acquire();
+		if ( !suppressed ) 
+			return 0;
+		if ( *suppressed ) [[unlikely]]
+			log<color, always_text>( "(%u similar entries suppressed)\n", *suppressed );
+		return log<color, always_text>( fmt, std::forward<params>( ps )... );
+	}
+
+	// Logs the entry unless it is identical to the previous entry of the call site,
+	// in which case only the repetition counter is incremented.
+	// - Repetitions of the last entry are reported once the call site logs a different 
+	//   entry, or on flush.
+	//
+	template<console_color color = CON_DEF, bool always_text = false, typename... params>
+	static int log_deduplicated( dedup_site& site, const char* fmt, params&&... ps )
+	{
+		uint64_t hash = impl::hash_entry( fmt, format::fix_parameter( ps )... );
+		if ( site.last_hash.load( std::memory_order_relaxed ) == hash )
+		{
+			site.pending.fetch_add( 1, std::memory_order_relaxed );
+			return 0;
+		}
+		site.last_hash.store( hash, std::memory_order_relaxed );
+		if ( uint32_t repeats = site.pending.exchange( 0, std::memory_order_relaxed ) ) [[unlikely]]
+			log<color, always_text>( "(last message repeated %u times)\n", repeats );
+		return log<color, always_text>( fmt, std::forward<params>( ps )... );
+	}
+};
+
+// Minimum log level compiled in, entries below it are removed entirely.
+//
+#ifndef VTIL_LOG_MIN_LEVEL
+	#ifdef _DEBUG
+		#define VTIL_LOG_MIN_LEVEL vtil::logger::level_trace
+	#else
+		#define VTIL_LOG_MIN_LEVEL vtil::logger::level_debug
+	#endif
+#endif
+
+// Logs an entry at the given level under the given category, the arguments
+// are only evaluated if the level is compiled in and enabled for the category.
+//
+#define VTIL_LOG_AT( level, category, ... )                                                                \
+	do                                                                                                     \
+	{                                                                                                      \
+		if constexpr ( ( level ) >= ( VTIL_LOG_MIN_LEVEL ) )                                               \
+		{                                                                                                  \
+			if ( ( category ).is_enabled( level ) )                                                        \
+				vtil::logger::log<vtil::logger::level_color( level ), vtil::logger::level_always_text( level )>( \
+					__VA_ARGS__ );                                                                         \
+		}                                                                                                  \
+	}                                                                                                      \
+	while ( 0 )
+#define VTIL_LOG_TRACE( category, ... ) VTIL_LOG_AT( vtil::logger::level_trace, category, __VA_ARGS__ )
+#define VTIL_LOG_DEBUG( category, ... ) VTIL_LOG_AT( vtil::logger::level_debug, category, __VA_ARGS__ )
+#define VTIL_LOG_INFO( category, ... )  VTIL_LOG_AT( vtil::logger::level_info,  category, __VA_ARGS__ )
+#define VTIL_LOG_WARN( category, ... )  VTIL_LOG_AT( vtil::logger::level_warn,  category, __VA_ARGS__ )
+#define VTIL_LOG_ERROR( category, ... ) VTIL_LOG_AT( vtil::logger::level_error, category, __VA_ARGS__ )
+
+// Rate-limited and deduplicated variants of VTIL_LOG_AT, state is kept per call site.
+//
+#define VTIL_LOG_LIMITED_AT( level, category, burst, per_second, ... )                                     \
+	do                                                                                                     \
+	{                                                                                                      \
+		if constexpr ( ( level ) >= ( VTIL_LOG_MIN_LEVEL ) )                                               \
+		{                                                                                                  \
+			if ( ( category ).is_enabled( level ) )                                                        \
+			{                                                                                              \
+				static vtil::logger::rate_limit_site __rate_limit_site( burst, per_second,                 \
+					vtil::logger::level_color( level ) );                                                  \
+				vtil::logger::log_limited<vtil::logger::level_color( level ), vtil::logger::level_always_text( level )>( \
+					__rate_limit_site, __VA_ARGS__ );                                                      \
+			}                                                                                              \
+		}                                                                                                  \
+	}                                                                                                      \
+	while ( 0 )
+#define VTIL_LOG_DEDUP_AT( level, category, ... )                                                          \
+	do                                                                                                     \
+	{                                                                                                      \
+		if constexpr ( ( level ) >= ( VTIL_LOG_MIN_LEVEL ) )                                               \
+		{                                                                                                  \
+			if ( ( category ).is_enabled( level ) )                                                        \
+			{                                                                                              \
+				static vtil::logger::dedup_site __dedup_site( vtil::logger::level_color( level ) );        \
+				vtil::logger::log_deduplicated<vtil::logger::level_color( level ), vtil::logger::level_always_text( level )>( \
+					__dedup_site, __VA_ARGS__ );                                                           \
+			}                                                                                              \
+		}                                                                                                  \
+	}                                                                                                      \
+	while ( 0 )
@@ -0,0 +1,99 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#include "serialization.hpp"
+#include <stdio.h>
+
+namespace vtil::serialization
+{
+	// Writes the header.
+	//
+	blob_writer::blob_writer( uint32_t schema )
+	{
+		size_t offset = allocate<blob_header>();
+		blob_header* header = at<blob_header>( offset );
+		memcpy( header->magic, blob_header::expected_magic, sizeof( header->magic ) );
+		header->version = blob_header::current_version;
+		header->byte_order = blob_header::native_byte_order;
+		header->schema = schema;
+	}
+
+	// Writes the string referenced by the rel_string at offset [field].
+	//
+	void blob_writer::write_string( size_t field, std::string_view value )
+	{
+		at<rel_string>( field )->length = value.size();
+		size_t data = allocate<char>( value.size() + 1 );
+		memcpy( at<char>( data ), value.data(), value.size() );
+		link( field, data );
+	}
+
+	// Finalizes the header and writes the blob to the given path.
+	//
+	bool blob_writer::save( const std::string& path )
+	{
+		buffer.resize( ( buffer.size() + blob_alignment - 1 ) & ~( blob_alignment - 1 ) );
+		at<blob_header>( 0 )->size = buffer.size();
+
+		FILE* out = fopen( path.c_str(), "wb" );
+		if ( !out )
+			return false;
+		bool success = fwrite( buffer.data(), 1, buffer.size(), out ) == buffer.size();
+		return ( fclose( out ) == 0 ) && success;
+	}
+
+	// Attaches to the blob at the given address after validating the header.
+	//
+	bool blob_view::attach( const void* data, size_t length, uint32_t schema )
+	{
+		const blob_header* header = ( const blob_header* ) data;
+		if ( length < sizeof( blob_header ) ||
+			 memcmp( header->magic, blob_header::expected_magic, sizeof( header->magic ) ) ||
+			 header->version != blob_header::current_version ||
+			 header->byte_order != blob_header::native_byte_order ||
+			 header->schema != schema ||
+			 header->size > length ||
+			 header->root + header->root_size > header->size )
+			return false;
+
+		base = ( const uint8_t* ) data;
+		size = ( size_t ) header->size;
+		return true;
+	}
+
+	// Maps the file at the given path and attaches to it.
+	//
+	bool blob_file::open( const std::string& path, uint32_t schema )
+	{
+		if ( !file.open( path ) )
+			return false;
+		if ( attach( file.base, file.size, schema ) )
+			return true;
+		file.close();
+		return false;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,344 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstring>
+#include <type_traits>
+#include "..\util\mapped_file.hpp"
+
+// Blobs are flat, versioned buffers that can be memory-mapped and accessed in place
+// without any deserialization, every reference within the blob is stored as an offset
+// relative to the field holding it so that the blob can be mapped at any address.
+// - Records are aligned to 8 bytes relative to the beginning of the blob.
+// - Types are described by a flat record type through the serializer<T> customization
+//   point, trivially copyable types are stored as is, and std::vector<T> (e.g. the result
+//   of a query collection) is stored as an array of the records of T.
+//
+namespace vtil::serialization
+{
+	static constexpr size_t blob_alignment = 8;
+
+	// Pointer relative to its own address, zero indicates null.
+	// - Copying or moving is not allowed as the copy would point elsewhere, so
+	//   records holding relative references can only be accessed in place.
+	//
+	template<typename T>
+	struct rel_ptr
+	{
+		int64_t offset = 0;
+
+		rel_ptr() = default;
+		rel_ptr( rel_ptr&& ) = delete;
+		rel_ptr( const rel_ptr& ) = delete;
+		rel_ptr& operator=( rel_ptr&& ) = delete;
+		rel_ptr& operator=( const rel_ptr& ) = delete;
+
+		const T* get() const { return offset ? ( const T* ) ( ( const uint8_t* ) this + offset ) : nullptr; }
+		const T* operator->() const { return get(); }
+		const T& operator*() const { return *get(); }
+		explicit operator bool() const { return offset != 0; }
+	};
+
+	// Array of records referenced by a relative pointer.
+	//
+	template<typename T>
+	struct rel_array
+	{
+		rel_ptr<T> data;
+		uint64_t length = 0;
+
+		const T* begin() const { return data.get(); }
+		const T* end() const { return data.get() + length; }
+		size_t size() const { return ( size_t ) length; }
+		bool empty() const { return length == 0; }
+		const T& operator[]( size_t n ) const { return begin()[ n ]; }
+
+		// Copies the array into a vector, only allowed for records without relative references.
+		//
+		std::vector<T> to_vector() const 
+		{ 
+			static_assert( std::is_trivially_copyable_v<T> && std::is_copy_constructible_v<T>, "Records holding relative references cannot be copied out of the blob." );
+			return { begin(), end() }; 
+		}
+	};
+
+	// Strings are stored as arrays of characters followed by a null terminator.
+	//
+	struct rel_string : rel_array<char>
+	{
+		std::string_view view() const { return { begin(), size() }; }
+		const char* c_str() const { return length ? begin() : ""; }
+	};
+
+	// Header at the beginning of each blob.
+	//
+	struct blob_header
+	{
+		static constexpr char expected_magic[ 8 ] = { 'V', 'T', 'I', 'L', 'F', 'L', 'A', 'T' };
+		static constexpr uint32_t current_version = 1;
+		static constexpr uint32_t native_byte_order = 0x01020304;
+
+		char magic[ 8 ];
+		uint32_t version;
+		uint32_t byte_order;
+
+		// Identifier of the root type chosen by the user and the size of its record,
+		// used to reject blobs written with a different layout.
+		//
+		uint32_t schema;
+		uint32_t root_size;
+
+		// Total size of the blob and the offset of the root record.
+		//
+		uint64_t size;
+		uint64_t root;
+	};
+
+	// Serializers describe how a type is stored, specializations should define:
+	// - using record_type = ...: Flat type stored within the blob.
+	// - static void write( blob_writer& out, size_t record, const T& value ): Fills the
+	//   record at the given offset, which is already allocated and zero-filled.
+	//
+	template<typename T>
+	struct serializer {};
+
+	// Record type of T, T itself if it has no serializer and is trivially copyable.
+	//
+	namespace impl
+	{
+		template<typename T>
+		static constexpr bool has_serializer_v = requires { typename serializer<T>::record_type; };
+
+		template<typename T>
+		static constexpr auto record_of()
+		{
+			if constexpr ( has_serializer_v<T> )
+				return std::type_identity<typename serializer<T>::record_type>{};
+			else
+			{
+				static_assert( std::is_trivially_copyable_v<T>, "Type cannot be serialized, specialize serialization::serializer<T>." );
+				return std::type_identity<T>{};
+			}
+		}
+	};
+	template<typename T>
+	using record_of = typename decltype( impl::record_of<T>() )::type;
+
+	// Writes a blob into a growing buffer, records are referred to by their offsets
+	// as pointers are invalidated whenever the buffer grows.
+	//
+	struct blob_writer
+	{
+		std::vector<uint8_t> buffer;
+
+		// Constructed with the schema identifier that readers are expected to match.
+		//
+		blob_writer( uint32_t schema = 0 );
+
+		// Allocates zero-filled space for [count] records of type T, returns the offset.
+		//
+		template<typename T>
+		size_t allocate( size_t count = 1 )
+		{
+			static_assert( alignof( T ) <= blob_alignment, "Record alignment is too large." );
+			size_t offset = ( buffer.size() + blob_alignment - 1 ) & ~( blob_alignment - 1 );
+			buffer.resize( offset + sizeof( T ) * count );
+			return offset;
+		}
+
+		// Returns a pointer to the record at the given offset, only valid until the next allocation.
+		//
+		template<typename T>
+		T* at( size_t offset ) { return ( T* ) ( buffer.data() + offset ); }
+
+		// Returns the offset of the given member of the record at the given offset.
+		//
+		template<typename R, typename F>
+		size_t field_of( size_t record, F R::* member )
+		{
+			return ( uint8_t* ) &( at<R>( record )->*member ) - buffer.data();
+		}
+
+		// Points the relative pointer at offset [field] to the offset [target].
+		//
+		void link( size_t field, size_t target )
+		{
+			at<rel_ptr<uint8_t>>( field )->offset = ( int64_t ) target - ( int64_t ) field;
+		}
+
+		// Serializes the value into the record at the given offset.
+		//
+		template<typename T>
+		void write_to( size_t record, const T& value )
+		{
+			if constexpr ( impl::has_serializer_v<T> )
+				serializer<T>::write( *this, record, value );
+			else
+				memcpy( at<T>( record ), &value, sizeof( T ) );
+		}
+
+		// Serializes the value into a new record, returns the offset.
+		//
+		template<typename T>
+		size_t write( const T& value )
+		{
+			size_t record = allocate<record_of<T>>();
+			write_to( record, value );
+			return record;
+		}
+
+		// Serializes the values into a new array referenced by the rel_array at offset [field].
+		//
+		template<typename T>
+		void write_array( size_t field, const T* data, size_t count )
+		{
+			at<rel_array<record_of<T>>>( field )->length = count;
+			if ( !count ) return;
+
+			size_t records = allocate<record_of<T>>( count );
+			if constexpr ( impl::has_serializer_v<T> )
+			{
+				for ( size_t i = 0; i != count; i++ )
+					write_to( records + i * sizeof( record_of<T> ), data[ i ] );
+			}
+			else
+			{
+				memcpy( at<T>( records ), data, sizeof( T ) * count );
+			}
+			link( field, records );
+		}
+		template<typename C>
+		void write_array( size_t field, const C& container ) 
+		{ 
+			if constexpr ( requires { std::data( container ); } )
+			{
+				write_array( field, std::data( container ), std::size( container ) );
+			}
+			else
+			{
+				std::vector<typename C::value_type> values( container.begin(), container.end() );
+				write_array( field, values.data(), values.size() );
+			}
+		}
+
+		// Writes the string referenced by the rel_string at offset [field].
+		//
+		void write_string( size_t field, std::string_view value );
+
+		// Sets the root record, should be invoked once before the blob is saved.
+		//
+		template<typename T>
+		void set_root( size_t offset )
+		{
+			at<blob_header>( 0 )->root = offset;
+			at<blob_header>( 0 )->root_size = sizeof( record_of<T> );
+		}
+
+		// Helper writing the value as the root record.
+		//
+		template<typename T>
+		size_t write_root( const T& value )
+		{
+			size_t offset = write( value );
+			set_root<T>( offset );
+			return offset;
+		}
+
+		// Finalizes the header and writes the blob to the given path.
+		//
+		bool save( const std::string& path );
+	};
+
+	// Serialization of vectors as arrays.
+	//
+	template<typename T>
+	struct serializer<std::vector<T>>
+	{
+		using record_type = rel_array<record_of<T>>;
+		static void write( blob_writer& out, size_t record, const std::vector<T>& value ) { out.write_array( record, value ); }
+	};
+
+	// Serialization of strings.
+	//
+	template<>
+	struct serializer<std::string>
+	{
+		using record_type = rel_string;
+		static void write( blob_writer& out, size_t record, const std::string& value ) { out.write_string( record, value ); }
+	};
+
+	// Read-only view of a blob in memory.
+	// - Only the header is validated, the contents are trusted.
+	//
+	struct blob_view
+	{
+		const uint8_t* base = nullptr;
+		size_t size = 0;
+
+		// Attaches to the blob at the given address, returns false if the header is
+		// invalid, the size is inconsistent or the schema does not match.
+		//
+		bool attach( const void* data, size_t length, uint32_t schema = 0 );
+
+		// Returns the header.
+		//
+		const blob_header* header() const { return ( const blob_header* ) base; }
+
+		// Returns the root record, null if the blob is not attached or the root was
+		// written with a different type.
+		//
+		template<typename T>
+		const record_of<T>* root() const
+		{
+			if ( !base || header()->root_size != sizeof( record_of<T> ) )
+				return nullptr;
+			return ( const record_of<T>* ) ( base + header()->root );
+		}
+
+		// Checks whether the given range lies within the blob.
+		//
+		bool contains( const void* ptr, size_t length ) const
+		{
+			return base <= ( const uint8_t* ) ptr && ( const uint8_t* ) ptr + length <= base + size;
+		}
+	};
+
+	// Blob mapped from a file.
+	//
+	struct blob_file : blob_view
+	{
+		mapped_file file;
+
+		// Maps the file at the given path and attaches to it.
+		//
+		bool open( const std::string& path, uint32_t schema = 0 );
+	};
+};
\ No newline at end of file
@@ -31,6 +31,7 @@
 #include <optional>
 #include <type_traits>
 #include "..\io\asserts.hpp"
+#include "..\io\formatting.hpp"
 
 // Declare the type we will used for bit lenghts of data.
 // - We are using int instead of char since most operations will end up casting
@@ -244,16 +245,7 @@ namespace vtil::math
 
         // Conversion to human-readable format.
         //
-        std::string to_string() const
-        {
-            std::string out;
-            for ( int n = bit_count - 1; n >= 0; n-- )
-            {
-                uint64_t mask = 1ull << n;
-                out += ( unknown_bits & mask ) ? '?' : ( known_bits & mask ) ? '1' : '0';
-            }
-            return out;
-        }
+        std::string to_string() const;
 
         // Implement basic comparison operators.
         // - Note: operator< should not be used for actual comparison but is exported for use of std:: maps etc.
@@ -262,4 +254,36 @@ namespace vtil::math
         inline bool operator!=( const bit_vector& o ) const { return bit_count != o.bit_count || known_bits != o.known_bits || unknown_bits || o.unknown_bits; }
         inline bool operator<( const bit_vector& o ) const { return bit_count < o.bit_count && known_bits < o.known_bits && unknown_bits < o.unknown_bits; }
     };
+
+    // Bit-vectors are serialized as is and can be accessed in place.
+    //
+    static_assert( std::is_trivially_copyable_v<bit_vector>, "Bit-vector must be trivially copyable." );
+};
+
+// Bit-vectors are formatted with "%s" as a string of 0/1/? for each bit starting from the MSB.
+//
+namespace vtil::format
+{
+    template<>
+    struct formatter<math::bit_vector>
+    {
+        static void write( output_buffer& out, const math::bit_vector& value )
+        {
+            char buffer[ 64 ];
+            size_t length = 0;
+            for ( int n = value.size() - 1; n >= 0; n-- )
+            {
+                uint64_t mask = 1ull << n;
+                buffer[ length++ ] = ( value.unknown_mask() & mask ) ? '?' : ( value.known_one() & mask ) ? '1' : '0';
+            }
+            out.append( buffer, length );
+        }
+    };
+};
+
+namespace vtil::math
+{
+    // Conversion to human-readable format.
+    //
+    inline std::string bit_vector::to_string() const { return format::typed_str( "%s", *this ); }
 };
\ No newline at end of file
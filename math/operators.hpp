@@ -31,7 +31,9 @@
 #include <intrin.h>
 #include <functional>
 #include <algorithm>
+#include <unordered_map>
 #include "bitwise.hpp"
+#include "..\io\serialization.hpp"
 
 namespace vtil::math
 {
@@ -148,8 +150,8 @@ namespace vtil::math
             {
                 // If it has a symbol, use it, else return in function format.
                 //
-                if ( symbol ) return symbol + rhs;
-                else          return format::str( "%s(%s)", function_name, lhs, rhs );
+                if ( symbol ) return format::typed_str( "%s%s", symbol, rhs );
+                else          return format::typed_str( "%s(%s)", function_name, rhs );
             }
             // If binary function:
             //
@@ -157,8 +159,8 @@ namespace vtil::math
             {
                 // If it has a symbol, use it, else return in function format.
                 //
-                if ( symbol ) return format::str( "(%s%s%s)", lhs, symbol, rhs );
-                else          return format::str( "%s(%s, %s)", function_name, lhs, rhs );
+                if ( symbol ) return format::typed_str( "(%s%s%s)", lhs, symbol, rhs );
+                else          return format::typed_str( "%s(%s, %s)", function_name, lhs, rhs );
             }
             unreachable();
         }
@@ -243,4 +245,64 @@ namespace vtil::math
     // and no size constraints.
     //
     bit_vector evaluate_partial( operator_id op, const bit_vector& lhs, const bit_vector& rhs );
+
+    // Flat record of an expression tree node as stored in serialized blobs, leaves
+    // have an invalid operator and are identified by the value and a user-defined identifier.
+    //
+    struct expression_record
+    {
+        operator_id op;
+        bit_vector value;
+        uint64_t uid;
+        serialization::rel_ptr<expression_record> lhs;
+        serialization::rel_ptr<expression_record> rhs;
+
+        bool is_leaf() const { return op == operator_id::invalid; }
+    };
+
+    // Serializes an expression tree of any node type and returns the offset of the root record, 
+    // [describe] fills the record of the node given and returns the pointers to its operands.
+    // - Nodes referenced multiple times are only written once.
+    //
+    template<typename node_type, typename fn_describe>
+    static size_t write_expression( serialization::blob_writer& out, const node_type& root, fn_describe&& describe )
+    {
+        std::unordered_map<const node_type*, size_t> written;
+        auto write_node = [ & ] ( auto&& self, const node_type& node ) -> size_t
+        {
+            if ( auto it = written.find( &node ); it != written.end() )
+                return it->second;
+
+            size_t record = out.template allocate<expression_record>();
+            std::pair<const node_type*, const node_type*> operands = describe( node, *out.template at<expression_record>( record ) );
+            if ( operands.first )
+            {
+                size_t lhs = self( self, *operands.first );
+                out.link( out.field_of( record, &expression_record::lhs ), lhs );
+            }
+            if ( operands.second )
+            {
+                size_t rhs = self( self, *operands.second );
+                out.link( out.field_of( record, &expression_record::rhs ), rhs );
+            }
+            written.emplace( &node, record );
+            return record;
+        };
+        return write_node( write_node, root );
+    }
+};
+
+// Operator identifiers are formatted with "%s" as the name of the associated function.
+//
+namespace vtil::format
+{
+    template<>
+    struct formatter<math::operator_id>
+    {
+        static void write( output_buffer& out, math::operator_id id )
+        {
+            const math::operator_desc* desc = math::descriptor_of( id );
+            out.append( desc ? desc->function_name : "invalid" );
+        }
+    };
 };
\ No newline at end of file
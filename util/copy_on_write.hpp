@@ -30,6 +30,7 @@
 #include <functional>
 #include <type_traits>
 #include "..\io\asserts.hpp"
+#include "memory_accounting.hpp"
 
 // Define _AddressOfReturnAddress() for compilers that do not have it.
 //
@@ -76,7 +77,9 @@ namespace vtil
 		template <typename T, typename... params>
 		inline static std::shared_ptr<T> make_shared( params&&... args )
 		{ 
-			std::shared_ptr<T> out = std::make_shared<T>( std::forward<params>( args )... );
+			// Allocations are attributed to the copy-on-write subsystem.
+			//
+			std::shared_ptr<T> out = memory::make_tracked_shared<memory::memory_tag::copy_on_write, T>( std::forward<params>( args )... );
 
 			// Billion dollar company yes?
 			//
@@ -26,41 +26,23 @@
 // POSSIBILITY OF SUCH DAMAGE.        
 //
 #include "critical_section.hpp"
-
-#if _WIN64
-	#include <intrin.h>
-#else
-	#include <sys/types.h>
-#endif
 #include "..\io\asserts.hpp"
 
 namespace vtil
 {
-	// Returns the thread identifier in a platform independent way,
-	// used instead of std::thread::get_id() as conversion to an integer
-	// requires std::hash...
-	//
-	tid_t get_thread_id()
-	{
-#if _WIN64
-		static_assert( sizeof( tid_t ) == 8, "Thread identifier must be defined as a quadword." );
-		return __readgsqword( 0x48 );
-#else
-		return ( tid_t ) gettid();
-#endif
-	}
-
 	// Tries locking the mutex, returns true on success and false on failure.
 	//
 	bool critical_section::try_lock()
 	{
+		tid_t tid = get_thread_id();
+
 		// If we could not acquire the mutex ownership:
 		//
 		if ( !mtx.try_lock() )
 		{
 			// If thread identifier does not match, report failure.
 			//
-			if ( owner.load() != get_thread_id() )
+			if ( owner.load() != tid )
 				return false;
 
 			// Increment lock count.
@@ -71,7 +53,7 @@ namespace vtil
 
 		// This thread now owns this mutex, report success.
 		//
-		owner.store( get_thread_id() );
+		owner.store( tid );
 		return true;
 	}
 
@@ -80,29 +62,32 @@ namespace vtil
 	//
 	void critical_section::lock()
 	{
+		tid_t tid = get_thread_id();
+
 		// If owner is not the current thread, spin until we acquire the mutex.
 		//
-		if ( owner != get_thread_id() )
+		if ( owner != tid )
 			mtx.lock();
 
 		// Increment the lock counter, if it was zero, store the current threads
 		// identifier as the owning thread identifier and return.
 		//
 		if ( lock_count++ == 0 )
-			owner.store( get_thread_id() );
+			owner.store( tid );
 
 		// Validate sanity.
 		//
-		fassert( owner.load() == get_thread_id() );
+		fassert( owner.load() == tid );
 	}
 
 	// Unlocks the mutex with the assumption that caller currently owns it.
 	//
 	void critical_section::unlock()
 	{
-		// Validate sanity.
+		// Validate sanity, unlocking a mutex not owned would corrupt the state
+		// so this is checked in release builds as well.
 		//
-		fassert( owner.load() == get_thread_id() );
+		fcheck( owner.load() == get_thread_id() );
 
 		// If lock count reached zero:
 		//
@@ -29,16 +29,10 @@
 #include <mutex>
 #include <atomic>
 #include <intrin.h>
+#include "thread_registry.hpp"
 
 namespace vtil
 {
-	// Returns the thread identifier in a platform independent way,
-	// used instead of std::thread::get_id() as conversion to an integer
-	// requires std::hash...
-	//
-	using tid_t = size_t;
-	tid_t get_thread_id();
-
 	// Implements a structure that mimics the way Win32 CRITICAL_SECTION objects work.
 	// As long as it's the same thread, this lock can be acquired multiple times.
 	//
@@ -83,5 +77,9 @@ namespace vtil
 		// Unlocks the mutex with the assumption that caller currently owns it.
 		//
 		void unlock();
+
+		// Checks whether the current thread owns the mutex.
+		//
+		bool is_owned() const { return owner.load() == get_thread_id(); }
 	};
 };
\ No newline at end of file
@@ -0,0 +1,80 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#include "interned_string.hpp"
+#include <unordered_set>
+#include <shared_mutex>
+#include <mutex>
+
+namespace vtil
+{
+	// The table is split into shards by the hash of the string to reduce
+	// contention, each shard is guarded by its own reader-writer lock.
+	//
+	struct intern_hash
+	{
+		using is_transparent = void;
+		size_t operator()( std::string_view str ) const { return std::hash<std::string_view>{}( str ); }
+	};
+	struct intern_shard
+	{
+		std::shared_mutex mutex;
+		std::unordered_set<std::string, intern_hash, std::equal_to<>> strings;
+	};
+	static constexpr size_t intern_shard_count = 16;
+
+	// Returns the interned instance of the given string, thread-safe.
+	//
+	interned_string intern( std::string_view str )
+	{
+		// Empty strings are represented by the null entry.
+		//
+		if ( str.empty() )
+			return {};
+
+		// Pick the shard, node-based storage guarantees the entries never move.
+		//
+		static intern_shard shards[ intern_shard_count ];
+		size_t hash = intern_hash{}( str );
+		intern_shard& shard = shards[ hash % intern_shard_count ];
+
+		// Try to find an existing entry holding only the shared lock.
+		//
+		{
+			std::shared_lock g( shard.mutex );
+			auto it = shard.strings.find( str );
+			if ( it != shard.strings.end() )
+				return interned_string{ &*it };
+		}
+
+		// Acquire the exclusive lock and insert, emplace will return the existing
+		// entry if another thread inserted it in the meantime.
+		//
+		std::unique_lock g( shard.mutex );
+		return interned_string{ &*shard.strings.emplace( str ).first };
+	}
+};
\ No newline at end of file
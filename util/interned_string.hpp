@@ -0,0 +1,87 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <string>
+#include <string_view>
+#include <functional>
+
+namespace vtil
+{
+	// Interned strings are handles to immutable strings stored in a global table
+	// which are never freed, so the same string is only ever stored once and the
+	// equality comparison is reduced to a pointer comparison.
+	//
+	struct interned_string
+	{
+		// Pointer to the entry in the global table, null for an empty string.
+		//
+		const std::string* entry = nullptr;
+
+		// Default constructor results in an empty string.
+		//
+		interned_string() = default;
+		explicit interned_string( const std::string* entry ) : entry( entry ) {}
+
+		// Accessors for the string.
+		//
+		const char* c_str() const { return entry ? entry->c_str() : ""; }
+		size_t size() const { return entry ? entry->size() : 0; }
+		bool empty() const { return !size(); }
+		std::string_view view() const { return entry ? std::string_view{ *entry } : std::string_view{}; }
+		operator std::string_view() const { return view(); }
+		operator std::string() const { return entry ? *entry : std::string{}; }
+		std::string to_string() const { return *this; }
+
+		// Equality is checked by comparing the entries, empty strings are never
+		// stored in the table so the null entry is the only empty string.
+		//
+		bool operator==( const interned_string& o ) const { return entry == o.entry; }
+		bool operator!=( const interned_string& o ) const { return entry != o.entry; }
+		bool operator==( std::string_view o ) const { return view() == o; }
+		bool operator!=( std::string_view o ) const { return view() != o; }
+
+		// Ordering is lexical so that sorted containers have a stable order.
+		//
+		bool operator<( const interned_string& o ) const { return entry != o.entry && view() < o.view(); }
+	};
+
+	// Returns the interned instance of the given string, thread-safe.
+	//
+	interned_string intern( std::string_view str );
+};
+
+// Hash of an interned string is the hash of the entry pointer.
+//
+namespace std
+{
+	template<>
+	struct hash<vtil::interned_string>
+	{
+		size_t operator()( const vtil::interned_string& str ) const { return hash<const void*>{}( str.entry ); }
+	};
+};
\ No newline at end of file
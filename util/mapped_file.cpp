@@ -0,0 +1,186 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#include "mapped_file.hpp"
+#include <utility>
+
+#if _WIN64
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <Windows.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+namespace vtil
+{
+	// Maps the file opened, shared implementation of ::create and ::open.
+	//
+#if _WIN64
+	static bool map_handle( mapped_file& out, HANDLE file, size_t size, bool writable )
+	{
+		HANDLE mapping = CreateFileMappingA( file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, ( DWORD ) ( uint64_t( size ) >> 32 ), ( DWORD ) size, nullptr );
+		void* base = mapping ? MapViewOfFile( mapping, writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size ) : nullptr;
+		if ( !base )
+		{
+			if ( mapping ) CloseHandle( mapping );
+			CloseHandle( file );
+			return false;
+		}
+		out.file_handle = file;
+		out.mapping_handle = mapping;
+		out.base = ( uint8_t* ) base;
+		out.size = size;
+		out.writable = writable;
+		return true;
+	}
+#else
+	static bool map_descriptor( mapped_file& out, int fd, size_t size, bool writable )
+	{
+		void* base = mmap( nullptr, size, writable ? ( PROT_READ | PROT_WRITE ) : PROT_READ, MAP_SHARED, fd, 0 );
+		if ( base == MAP_FAILED )
+		{
+			::close( fd );
+			return false;
+		}
+		out.file_descriptor = fd;
+		out.base = ( uint8_t* ) base;
+		out.size = size;
+		out.writable = writable;
+		return true;
+	}
+#endif
+
+	// Creates or truncates the file at the given path to the given size and maps it for writing.
+	//
+	bool mapped_file::create( const std::string& path, size_t new_size )
+	{
+		close();
+		if ( !new_size )
+			return false;
+#if _WIN64
+		HANDLE file = CreateFileA( path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr );
+		if ( file == INVALID_HANDLE_VALUE )
+			return false;
+		return map_handle( *this, file, new_size, true );
+#else
+		int fd = ::open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+		if ( fd < 0 )
+			return false;
+		if ( ftruncate( fd, new_size ) != 0 )
+		{
+			::close( fd );
+			return false;
+		}
+		return map_descriptor( *this, fd, new_size, true );
+#endif
+	}
+
+	// Maps an existing file in its entirety.
+	//
+	bool mapped_file::open( const std::string& path, bool open_writable )
+	{
+		close();
+#if _WIN64
+		HANDLE file = CreateFileA( path.c_str(), open_writable ? ( GENERIC_READ | GENERIC_WRITE ) : GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+		if ( file == INVALID_HANDLE_VALUE )
+			return false;
+		LARGE_INTEGER file_size;
+		if ( !GetFileSizeEx( file, &file_size ) || !file_size.QuadPart )
+		{
+			CloseHandle( file );
+			return false;
+		}
+		return map_handle( *this, file, ( size_t ) file_size.QuadPart, open_writable );
+#else
+		int fd = ::open( path.c_str(), open_writable ? O_RDWR : O_RDONLY );
+		if ( fd < 0 )
+			return false;
+		struct stat st;
+		if ( fstat( fd, &st ) != 0 || !st.st_size )
+		{
+			::close( fd );
+			return false;
+		}
+		return map_descriptor( *this, fd, ( size_t ) st.st_size, open_writable );
+#endif
+	}
+
+	// Writes the modified pages back to the file.
+	//
+	void mapped_file::flush()
+	{
+		if ( !base || !writable )
+			return;
+#if _WIN64
+		FlushViewOfFile( base, 0 );
+#else
+		msync( base, size, MS_SYNC );
+#endif
+	}
+
+	// Unmaps the file, flushing it first if writable.
+	//
+	void mapped_file::close()
+	{
+		if ( !base )
+			return;
+		flush();
+#if _WIN64
+		UnmapViewOfFile( base );
+		CloseHandle( mapping_handle );
+		CloseHandle( file_handle );
+		mapping_handle = nullptr;
+		file_handle = nullptr;
+#else
+		munmap( base, size );
+		::close( file_descriptor );
+		file_descriptor = -1;
+#endif
+		base = nullptr;
+		size = 0;
+		writable = false;
+	}
+
+	// Swaps the state with another object.
+	//
+	void mapped_file::swap( mapped_file& o )
+	{
+		std::swap( base, o.base );
+		std::swap( size, o.size );
+		std::swap( writable, o.writable );
+#if _WIN64
+		std::swap( file_handle, o.file_handle );
+		std::swap( mapping_handle, o.mapping_handle );
+#else
+		std::swap( file_descriptor, o.file_descriptor );
+#endif
+	}
+};
\ No newline at end of file
@@ -0,0 +1,90 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <stdint.h>
+#include <string>
+
+namespace vtil
+{
+	// Memory-mapped view of a file, the mapping is shared with the file so that
+	// written data persists even if the process terminates abruptly.
+	//
+	struct mapped_file
+	{
+		// Base address and the size of the mapping, null if not mapped.
+		//
+		uint8_t* base = nullptr;
+		size_t size = 0;
+		bool writable = false;
+
+		// OS handles.
+		//
+#if _WIN64
+		void* file_handle = nullptr;
+		void* mapping_handle = nullptr;
+#else
+		int file_descriptor = -1;
+#endif
+
+		// Default constructor results in an unmapped object, copying is not allowed.
+		//
+		mapped_file() = default;
+		mapped_file( const mapped_file& ) = delete;
+		mapped_file& operator=( const mapped_file& ) = delete;
+		mapped_file( mapped_file&& o ) noexcept { swap( o ); }
+		mapped_file& operator=( mapped_file&& o ) noexcept { swap( o ); return *this; }
+		~mapped_file() { close(); }
+
+		// Creates or truncates the file at the given path to the given size and maps it
+		// for writing, the contents are zero-filled.
+		//
+		bool create( const std::string& path, size_t size );
+
+		// Maps an existing file in its entirety, returns false if it does not exist or
+		// cannot be mapped.
+		//
+		bool open( const std::string& path, bool writable = false );
+
+		// Writes the modified pages back to the file.
+		//
+		void flush();
+
+		// Unmaps the file, flushing it first if writable.
+		//
+		void close();
+
+		// Swaps the state with another object.
+		//
+		void swap( mapped_file& o );
+
+		// Helpers.
+		//
+		bool is_open() const { return base != nullptr; }
+		explicit operator bool() const { return is_open(); }
+	};
+};
\ No newline at end of file
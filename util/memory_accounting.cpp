@@ -0,0 +1,122 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#include "memory_accounting.hpp"
+#include <chrono>
+#include <mutex>
+#include "..\io\logger.hpp"
+
+namespace vtil::memory
+{
+	// Global state of each tag.
+	//
+	impl::global_counters* impl::get_global_counters()
+	{
+		static global_counters counters[ tag_count ];
+		return counters;
+	}
+
+	// Merges the thread-local state of the given tag into the global state.
+	//
+	void impl::local_counters::flush( size_t idx )
+	{
+		global_counters& global = get_global_counters()[ idx ];
+
+		// Merge the totals.
+		//
+		if ( total_allocations[ idx ] )
+		{
+			global.total_allocations.fetch_add( total_allocations[ idx ], std::memory_order_relaxed );
+			global.total_bytes.fetch_add( total_bytes[ idx ], std::memory_order_relaxed );
+			total_allocations[ idx ] = 0;
+			total_bytes[ idx ] = 0;
+		}
+
+		// Merge the live bytes and update the peak if it was exceeded.
+		//
+		if ( live_bytes[ idx ] )
+		{
+			int64_t live = global.live_bytes.fetch_add( live_bytes[ idx ], std::memory_order_relaxed ) + live_bytes[ idx ];
+			live_bytes[ idx ] = 0;
+
+			int64_t peak = global.peak_bytes.load( std::memory_order_relaxed );
+			while ( live > peak && !global.peak_bytes.compare_exchange_weak( peak, live, std::memory_order_relaxed ) );
+		}
+	}
+
+	// Returns the statistics of the given tag.
+	//
+	tag_statistics statistics( memory_tag tag )
+	{
+		impl::global_counters& global = impl::get_global_counters()[ ( size_t ) tag ];
+		return {
+			global.live_bytes.load( std::memory_order_relaxed ),
+			global.peak_bytes.load( std::memory_order_relaxed ),
+			global.total_bytes.load( std::memory_order_relaxed ),
+			global.total_allocations.load( std::memory_order_relaxed )
+		};
+	}
+
+	// State of the previous report, initialized at startup so that the first
+	// report calculates the rate since the process started.
+	//
+	using clock = std::chrono::steady_clock;
+	static std::mutex report_mutex;
+	static clock::time_point prev_time = clock::now();
+	static uint64_t prev_total[ tag_count ] = { 0 };
+
+	// Logs the statistics of every tag, including the allocation rate
+	// since the previous report.
+	//
+	void report()
+	{
+		std::lock_guard g( report_mutex );
+
+		// Merge the state of the current thread so that it is reflected.
+		//
+		flush();
+
+		clock::time_point time = clock::now();
+		double elapsed = std::chrono::duration<double>( time - prev_time ).count();
+		prev_time = time;
+
+		logger::log<logger::CON_YLW>( "Memory usage (tracked allocations only):\n" );
+		for ( size_t i = 0; i != tag_count; i++ )
+		{
+			tag_statistics stats = statistics( ( memory_tag ) i );
+			double rate = elapsed > 0 ? ( stats.total_bytes - prev_total[ i ] ) / elapsed : 0.0;
+			prev_total[ i ] = stats.total_bytes;
+
+			logger::log
+			(
+				" %-14s live: %10.2f KB | peak: %10.2f KB | total: %10.2f KB in %llu allocations | rate: %10.2f KB/s\n",
+				tag_names[ i ], stats.live_bytes / 1024.0, stats.peak_bytes / 1024.0,
+				stats.total_bytes / 1024.0, stats.total_allocations, rate / 1024.0
+			);
+		}
+	}
+};
\ No newline at end of file
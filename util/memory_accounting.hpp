@@ -0,0 +1,182 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <iterator>
+#include <type_traits>
+
+// Memory accounting is used to attribute allocations to the subsystem that made them,
+// counters are kept thread-local and are only merged into the global state once the
+// difference exceeds a threshold, so that the accounting can be left on in production.
+// - Only allocations made through the tracked allocators below are counted, the report
+//   is a lower bound of the memory used by each subsystem.
+//
+namespace vtil::memory
+{
+	// Subsystems allocations are attributed to, and what is covered by each:
+	//  - general:       Tracked allocations made without a specific tag.
+	//  - disassembly:   Instructions held by the decode cache, the control block and the 
+	//                   instruction object only; the heap storage of their members and the 
+	//                   allocations made by Capstone itself are not tracked.
+	//  - copy_on_write: Objects owned by copy-on-write references, excluding their members.
+	//
+	enum class memory_tag : uint8_t
+	{
+		general,
+		disassembly,
+		copy_on_write,
+		max,
+	};
+	static constexpr size_t tag_count = ( size_t ) memory_tag::max;
+	static constexpr const char* tag_names[] = { "general", "disassembly", "copy-on-write" };
+	static_assert( std::size( tag_names ) == tag_count, "Memory tag name table is invalid." );
+
+	// Statistics of a single tag.
+	// - Live and peak bytes may lag behind the real value by up to the flush
+	//   threshold per thread, since the thread-local counters are merged lazily.
+	//
+	struct tag_statistics
+	{
+		int64_t live_bytes;
+		int64_t peak_bytes;
+		uint64_t total_bytes;
+		uint64_t total_allocations;
+	};
+
+	// Implementation details.
+	//
+	namespace impl
+	{
+		// Number of bytes the thread-local state can diverge by before it's merged.
+		//
+		static constexpr int64_t flush_threshold = 64 * 1024;
+
+		// Global state of each tag.
+		//
+		struct global_counters
+		{
+			std::atomic<int64_t> live_bytes = 0;
+			std::atomic<int64_t> peak_bytes = 0;
+			std::atomic<uint64_t> total_bytes = 0;
+			std::atomic<uint64_t> total_allocations = 0;
+		};
+		global_counters* get_global_counters();
+
+		// Thread-local state of each tag, merged into the global state either
+		// when the threshold is exceeded or the thread exits.
+		//
+		struct local_counters
+		{
+			int64_t live_bytes[ tag_count ] = { 0 };
+			uint64_t total_bytes[ tag_count ] = { 0 };
+			uint64_t total_allocations[ tag_count ] = { 0 };
+
+			void flush( size_t idx );
+			void flush() { for ( size_t i = 0; i != tag_count; i++ ) flush( i ); }
+			~local_counters() { flush(); }
+		};
+		inline local_counters& local()
+		{
+			static thread_local local_counters counters;
+			return counters;
+		}
+	};
+
+	// Records an allocation or a free of [n] bytes under the given tag.
+	//
+	__forceinline static void on_allocate( memory_tag tag, size_t n )
+	{
+		impl::local_counters& local = impl::local();
+		size_t idx = ( size_t ) tag;
+		local.total_allocations[ idx ]++;
+		local.total_bytes[ idx ] += n;
+		if ( ( local.live_bytes[ idx ] += n ) >= impl::flush_threshold )
+			local.flush( idx );
+	}
+	__forceinline static void on_free( memory_tag tag, size_t n )
+	{
+		impl::local_counters& local = impl::local();
+		size_t idx = ( size_t ) tag;
+		if ( ( local.live_bytes[ idx ] -= n ) <= -impl::flush_threshold )
+			local.flush( idx );
+	}
+
+	// Merges the state of the current thread into the global state.
+	//
+	inline static void flush() { impl::local().flush(); }
+
+	// Returns the statistics of the given tag.
+	//
+	tag_statistics statistics( memory_tag tag );
+
+	// Logs the statistics of every tag, including the allocation rate
+	// since the previous report.
+	//
+	void report();
+
+	// Standard allocator attributing all allocations to the given tag.
+	//
+	template<typename T, memory_tag tag = memory_tag::general>
+	struct tracked_allocator
+	{
+		using value_type = T;
+		template<typename U> struct rebind { using other = tracked_allocator<U, tag>; };
+
+		tracked_allocator() = default;
+		template<typename U>
+		tracked_allocator( const tracked_allocator<U, tag>& ) {}
+
+		T* allocate( size_t n )
+		{
+			on_allocate( tag, n * sizeof( T ) );
+			return std::allocator<T>{}.allocate( n );
+		}
+		void deallocate( T* p, size_t n )
+		{
+			on_free( tag, n * sizeof( T ) );
+			std::allocator<T>{}.deallocate( p, n );
+		}
+
+		template<typename U> bool operator==( const tracked_allocator<U, tag>& ) const { return true; }
+		template<typename U> bool operator!=( const tracked_allocator<U, tag>& ) const { return false; }
+	};
+
+	// Helpers for commonly used tracked types.
+	//
+	template<typename T, memory_tag tag>
+	using tracked_vector = std::vector<T, tracked_allocator<T, tag>>;
+
+	template<memory_tag tag, typename T, typename... params>
+	inline static std::shared_ptr<T> make_tracked_shared( params&&... args )
+	{
+		return std::allocate_shared<T>( tracked_allocator<T, tag>{}, std::forward<params>( args )... );
+	}
+};
\ No newline at end of file
@@ -0,0 +1,151 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#include "perf_counters.hpp"
+#include <algorithm>
+
+#if __linux__
+	#include <unistd.h>
+	#include <sys/syscall.h>
+	#include <linux/perf_event.h>
+#endif
+
+namespace vtil::perf
+{
+#if __linux__
+	// Event descriptors for each counter.
+	//
+	struct event_desc
+	{
+		uint32_t type;
+		uint64_t config;
+	};
+	static constexpr event_desc event_descriptors[] =
+	{
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 ) },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	};
+	static_assert( std::size( event_descriptors ) == counter_count, "Event descriptor table is invalid." );
+#endif
+
+	// Opens the counters for the current thread.
+	//
+	counter_group::counter_group()
+	{
+		for ( int& fd : fds )
+			fd = -1;
+
+#if __linux__
+		for ( size_t i = 0; i != counter_count; i++ )
+		{
+			// Describe the event, user-mode only, measuring the calling thread on any CPU.
+			//
+			perf_event_attr attr = {};
+			attr.size = sizeof( perf_event_attr );
+			attr.type = event_descriptors[ i ].type;
+			attr.config = event_descriptors[ i ].config;
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+
+			// The first counter opened becomes the leader and the rest join its group,
+			// counters that cannot be opened are left as unavailable.
+			//
+			fds[ i ] = ( int ) syscall( SYS_perf_event_open, &attr, 0, -1, leader, 0 );
+			if ( leader < 0 )
+				leader = fds[ i ];
+		}
+#endif
+	}
+
+	counter_group::~counter_group()
+	{
+#if __linux__
+		// Close the leader last.
+		//
+		for ( int fd : fds )
+			if ( fd >= 0 && fd != leader ) close( fd );
+		if ( leader >= 0 ) close( leader );
+#endif
+	}
+
+	// Returns whether or not any of the counters could be opened.
+	//
+	bool counter_group::is_available() const
+	{
+		return leader >= 0;
+	}
+
+	// Reads the current raw value of every counter along with the time
+	// the group was enabled and running.
+	//
+	counter_sample counter_group::read() const
+	{
+		counter_sample sample;
+#if __linux__
+		if ( leader < 0 )
+			return sample;
+
+		// Read the group, laid out as [count][time enabled][time running][values...]
+		// where the values are in the order the counters were opened.
+		//
+		uint64_t data[ 3 + counter_count ];
+		ssize_t length = ::read( leader, data, sizeof( data ) );
+		if ( length < ssize_t( 3 * sizeof( uint64_t ) ) )
+			return sample;
+		size_t count = std::min<size_t>( data[ 0 ], length / sizeof( uint64_t ) - 3 );
+		sample.time_enabled = data[ 1 ];
+		sample.time_running = data[ 2 ];
+
+		for ( size_t i = 0, j = 0; i != counter_count && j != count; i++ )
+		{
+			if ( fds[ i ] < 0 ) continue;
+			sample.values[ i ] = data[ 3 + j++ ];
+			sample.valid[ i ] = true;
+		}
+#endif
+		return sample;
+	}
+
+	// Returns the counter group of the current thread, created upon first use.
+	//
+	counter_group& local_counters()
+	{
+		static thread_local counter_group group;
+		return group;
+	}
+
+	// Returns whether or not hardware counters are available in this process.
+	//
+	bool is_supported()
+	{
+		return local_counters().is_available();
+	}
+};
\ No newline at end of file
@@ -0,0 +1,207 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <iterator>
+#include "..\io\formatting.hpp"
+
+// Hardware performance counters are sampled using perf_event_open and are only
+// available on Linux, on any other platform or when the kernel does not allow
+// access (e.g. perf_event_paranoid, containers) the counters are simply reported
+// as unavailable and the measurements are no-ops.
+//
+namespace vtil::perf
+{
+	// Counters that are sampled.
+	//
+	enum class counter_id : uint8_t
+	{
+		cycles,
+		instructions,
+		l1d_misses,
+		llc_misses,
+		branch_misses,
+		max,
+	};
+	static constexpr size_t counter_count = ( size_t ) counter_id::max;
+	static constexpr const char* counter_names[] = { "cycles", "instructions", "l1d-misses", "llc-misses", "branch-misses" };
+	static_assert( std::size( counter_names ) == counter_count, "Counter name table is invalid." );
+
+	// Values of each counter, either as an absolute reading or as the
+	// difference between two readings.
+	// - Values are raw counts, if the kernel had to multiplex the counters they only
+	//   ran for [time_running] out of [time_enabled] nanoseconds and are scaled when
+	//   queried, which keeps the difference of two readings exact.
+	//
+	struct counter_sample
+	{
+		uint64_t values[ counter_count ] = { 0 };
+		bool valid[ counter_count ] = { false };
+		uint64_t time_enabled = 0;
+		uint64_t time_running = 0;
+
+		// Returns the raw value extrapolated to the entire time enabled.
+		//
+		uint64_t scaled( size_t idx ) const
+		{
+			if ( time_running && time_running < time_enabled )
+				return uint64_t( double( values[ idx ] ) * time_enabled / time_running );
+			return values[ idx ];
+		}
+
+		// Getters for each counter.
+		//
+		uint64_t operator[]( counter_id id ) const { return scaled( ( size_t ) id ); }
+		bool has( counter_id id ) const { return valid[ ( size_t ) id ]; }
+
+		// Instructions per cycle, zero if either is not available, the counters
+		// are in the same group so the scale cancels out.
+		//
+		double ipc() const
+		{
+			if ( !has( counter_id::cycles ) || !has( counter_id::instructions ) || !values[ ( size_t ) counter_id::cycles ] )
+				return 0.0;
+			return double( values[ ( size_t ) counter_id::instructions ] ) / values[ ( size_t ) counter_id::cycles ];
+		}
+
+		// Accumulation and difference of samples, a counter is only valid
+		// in the result if it was valid in both.
+		//
+		counter_sample operator-( const counter_sample& o ) const
+		{
+			counter_sample out;
+			for ( size_t i = 0; i != counter_count; i++ )
+			{
+				out.valid[ i ] = valid[ i ] && o.valid[ i ];
+				out.values[ i ] = out.valid[ i ] ? values[ i ] - o.values[ i ] : 0;
+			}
+			out.time_enabled = time_enabled - o.time_enabled;
+			out.time_running = time_running - o.time_running;
+			return out;
+		}
+		counter_sample& operator+=( const counter_sample& o )
+		{
+			for ( size_t i = 0; i != counter_count; i++ )
+			{
+				valid[ i ] = valid[ i ] && o.valid[ i ];
+				values[ i ] = valid[ i ] ? values[ i ] + o.values[ i ] : 0;
+			}
+			time_enabled += o.time_enabled;
+			time_running += o.time_running;
+			return *this;
+		}
+
+		// Conversion to human-readable format.
+		//
+		std::string to_string() const
+		{
+			std::string out;
+			for ( size_t i = 0; i != counter_count; i++ )
+			{
+				if ( !valid[ i ] ) continue;
+				if ( !out.empty() ) out += ", ";
+				out += format::str( "%s: %llu", counter_names[ i ], scaled( i ) );
+			}
+			if ( out.empty() )
+				return "<counters unavailable>";
+			return out + format::str( ", ipc: %.2f", ipc() );
+		}
+	};
+
+	// Group of counters measuring the thread that created it, the counters
+	// run continuously once opened so regions are measured by taking the
+	// difference of two readings, which makes nesting measurements trivial.
+	// - Counters are opened as a single perf group so that they are scheduled
+	//   together and read atomically.
+	//
+	struct counter_group
+	{
+		// File descriptors of each counter, -1 if not available, and the
+		// descriptor of the group leader.
+		//
+		int fds[ counter_count ];
+		int leader = -1;
+
+		// Opens the counters for the current thread.
+		//
+		counter_group();
+		~counter_group();
+
+		// Copying or moving this object is not allowed.
+		//
+		counter_group( counter_group&& ) = delete;
+		counter_group( const counter_group& ) = delete;
+		counter_group& operator=( counter_group&& ) = delete;
+		counter_group& operator=( const counter_group& ) = delete;
+
+		// Returns whether or not any of the counters could be opened.
+		//
+		bool is_available() const;
+
+		// Reads the current raw value of every counter along with the time
+		// the group was enabled and running.
+		//
+		counter_sample read() const;
+	};
+
+	// Returns the counter group of the current thread, created upon first use.
+	//
+	counter_group& local_counters();
+
+	// Returns whether or not hardware counters are available in this process.
+	//
+	bool is_supported();
+
+	// RAII hack for measuring the counters until the scope ends, the difference
+	// is written into the sample given.
+	//
+	struct scope_counters
+	{
+		counter_sample& output;
+		counter_sample begin;
+		bool active = true;
+
+		scope_counters( counter_sample& output ) : output( output ), begin( local_counters().read() ) {}
+		void end() { if ( active ) output = local_counters().read() - begin, active = false; }
+		~scope_counters() { end(); }
+	};
+
+	// Convenience wrapper measuring the counters of the callable invoked.
+	//
+	template<typename T>
+	static counter_sample measure( T&& fn )
+	{
+		counter_sample result;
+		{
+			scope_counters _c( result );
+			fn();
+		}
+		return result;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,247 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#include "profiler.hpp"
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+namespace vtil::profiler
+{
+	// List of all thread buffers ever created, buffers are kept alive after the
+	// owning thread exits so that the report still includes their records.
+	//
+	static std::mutex registry_mutex;
+	static std::vector<std::unique_ptr<thread_buffer>> registry;
+
+	// Allocates a new buffer for the current thread and registers it.
+	//
+	thread_buffer* impl::register_thread()
+	{
+		auto buffer = std::make_unique<thread_buffer>();
+		buffer->thread_id = get_thread_id();
+
+		std::lock_guard g( registry_mutex );
+		return registry.emplace_back( std::move( buffer ) ).get();
+	}
+
+	// Returns the number of TSC ticks per second, calibrated against the
+	// steady clock upon the first call.
+	//
+	double ticks_per_second()
+	{
+		static const double result = [ ] ()
+		{
+			using clock = std::chrono::steady_clock;
+
+			// Spin for a short while and compare the number of ticks elapsed
+			// with the real time elapsed.
+			//
+			clock::time_point t0 = clock::now();
+			tsc_t c0 = timestamp();
+			while ( clock::now() - t0 < std::chrono::milliseconds( 20 ) );
+			clock::time_point t1 = clock::now();
+			tsc_t c1 = timestamp();
+
+			return ( c1 - c0 ) / std::chrono::duration<double>( t1 - t0 ).count();
+		}( );
+		return result;
+	}
+
+	// Takes a snapshot of the records that are still in the ring, sorted by the time
+	// they were entered so that parents are always visited before their children.
+	//
+	static std::vector<zone_record> snapshot( const thread_buffer& buffer )
+	{
+		size_t end = buffer.write_index.load( std::memory_order_acquire );
+		size_t begin = end > thread_buffer::capacity ? end - thread_buffer::capacity : 0;
+		begin = std::min( std::max( begin, buffer.reset_index.load( std::memory_order_acquire ) ), end );
+
+		// Records overwritten by the owning thread while we were reading are skipped.
+		//
+		std::vector<zone_record> records;
+		records.reserve( end - begin );
+		for ( size_t i = begin; i != end; i++ )
+		{
+			zone_record record;
+			if ( buffer.read( i, record ) )
+				records.push_back( record );
+		}
+
+		std::sort( records.begin(), records.end(), [ ] ( auto& a, auto& b )
+		{
+			return a.begin != b.begin ? a.begin < b.begin : a.depth < b.depth;
+		} );
+		return records;
+	}
+
+	// Merges the records of every thread into a single call tree.
+	//
+	call_node collect()
+	{
+		call_node root;
+		std::lock_guard g( registry_mutex );
+
+		for ( auto& buffer : registry )
+		{
+			std::vector<zone_record> records = snapshot( *buffer );
+
+			// Walk the records maintaining the stack of active nodes.
+			// - If the parent was overwritten in the ring, attach to the deepest
+			//   node we know of instead.
+			//
+			std::vector<call_node*> stack;
+			for ( auto& record : records )
+			{
+				size_t depth = std::min<size_t>( record.depth, stack.size() );
+				call_node* parent = depth ? stack[ depth - 1 ] : &root;
+
+				call_node& node = parent->children[ record.name ];
+				node.calls++;
+				node.total += record.end - record.begin;
+
+				stack.resize( depth );
+				stack.push_back( &node );
+			}
+		}
+
+		// Sum up the totals of the top-level nodes for the root.
+		//
+		for ( auto& [name, child] : root.children )
+			root.total += child.total, root.calls += child.calls;
+		return root;
+	}
+
+	// Discards all records collected so far.
+	// - The write index is owned by the thread, so only the index below which records
+	//   are ignored is moved, which also covers buffers of threads that already exited.
+	//
+	void reset()
+	{
+		std::lock_guard g( registry_mutex );
+		for ( auto& buffer : registry )
+			buffer->reset_index.store( buffer->write_index.load( std::memory_order_acquire ), std::memory_order_release );
+	}
+
+	// Logs the call tree recursively.
+	//
+	static void report_node( const call_node& node, double min_ms )
+	{
+		for ( auto& [name, child] : node.children )
+		{
+			double total_ms = to_ms( child.total );
+			if ( total_ms < min_ms )
+				continue;
+
+			logger::log
+			(
+				"%s: %.3fms total, %.3fms self, %llu calls\n",
+				name, total_ms, to_ms( child.self() ), child.calls
+			);
+
+			logger::scope_padding _p( 1 );
+			report_node( child, min_ms );
+		}
+	}
+
+	// Logs the call tree, nested zones are printed using the logger padding,
+	// nodes that took less than [min_ms] in total are omitted.
+	//
+	void report( double min_ms )
+	{
+		call_node root = collect();
+		logger::log<logger::CON_YLW>( "Profiler report (%.3fms total):\n", to_ms( root.total ) );
+		logger::scope_padding _p( 1 );
+		report_node( root, min_ms );
+	}
+
+	// Writes the string escaped for use in JSON.
+	//
+	static void write_json_string( FILE* out, const char* str )
+	{
+		fputc( '"', out );
+		for ( ; *str; str++ )
+		{
+			char c = *str;
+			if ( c == '"' || c == '\\' )
+				fprintf( out, "\\%c", c );
+			else if ( uint8_t( c ) < 0x20 )
+				fprintf( out, "\\u%04x", c );
+			else
+				fputc( c, out );
+		}
+		fputc( '"', out );
+	}
+
+	// Writes every zone recorded as complete events in the Chrome trace event JSON format.
+	//
+	bool export_chrome_trace( const std::string& path )
+	{
+		FILE* out = fopen( path.c_str(), "wb" );
+		if ( !out )
+			return false;
+
+		// Take the snapshots and find the earliest timestamp to use as the origin.
+		//
+		std::vector<std::pair<tid_t, std::vector<zone_record>>> threads;
+		tsc_t origin = ~0ull;
+		{
+			std::lock_guard g( registry_mutex );
+			for ( auto& buffer : registry )
+			{
+				auto& [tid, records] = threads.emplace_back( buffer->thread_id, snapshot( *buffer ) );
+				if ( !records.empty() )
+					origin = std::min( origin, records.front().begin );
+			}
+		}
+
+		// Write a complete event for each zone, timestamps are in microseconds.
+		//
+		double us_per_tick = 1e6 / ticks_per_second();
+		bool first = true;
+		fputs( "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", out );
+		for ( auto& [tid, records] : threads )
+		{
+			for ( auto& record : records )
+			{
+				fputs( first ? "{\"name\":" : ",\n{\"name\":", out );
+				write_json_string( out, record.name );
+				fprintf
+				(
+					out, ",\"cat\":\"vtil\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%llu}",
+					( record.begin - origin ) * us_per_tick, ( record.end - record.begin ) * us_per_tick, ( unsigned long long ) tid
+				);
+				first = false;
+			}
+		}
+		fputs( "\n]}\n", out );
+		return fclose( out ) == 0;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,105 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <map>
+#include "zone_recorder.hpp"
+#include "..\io\logger.hpp"
+
+namespace vtil::profiler
+{
+	// Zone that also increments the logger padding until the scope ends,
+	// and logs the time spent at the previous padding level on exit.
+	//
+	struct scope_timer : scope_zone
+	{
+		logger::scope_padding padding;
+
+		scope_timer( const char* name, unsigned u = 1 ) : scope_zone( name ), padding( u ) {}
+		~scope_timer()
+		{
+			tsc_t ticks = end();
+			padding.end();
+			logger::log<logger::CON_CYN>( "[%s] took %.3fms\n", name, to_ms( ticks ) );
+		}
+	};
+
+	// Node of the aggregated call tree.
+	//
+	struct call_node
+	{
+		uint64_t calls = 0;
+		tsc_t total = 0;
+		std::map<std::string, call_node> children;
+
+		// Returns the ticks spent in this node but not in any of its children.
+		//
+		tsc_t self() const
+		{
+			tsc_t sum = 0;
+			for ( auto& [name, child] : children )
+				sum += child.total;
+			return sum > total ? 0 : total - sum;
+		}
+	};
+
+	// Merges the records of every thread into a single call tree.
+	// - Zones that are still active are not included.
+	//
+	call_node collect();
+
+	// Discards all records collected so far.
+	//
+	void reset();
+
+	// Logs the call tree, nested zones are printed using the logger padding,
+	// nodes that took less than [min_ms] in total are omitted.
+	//
+	void report( double min_ms = 0.0 );
+
+	// Writes every zone recorded as complete events in the Chrome trace event
+	// JSON format, which can be loaded by chrome://tracing or the Perfetto UI
+	// to view a timeline of every thread. Returns false on failure.
+	//
+	bool export_chrome_trace( const std::string& path );
+};
+
+// Helpers used to profile a scope with a single line, compiled to nothing
+// unless profiling is enabled.
+//
+#if VTIL_PROFILER
+	#define profiler__concat_(x, y) x##y
+	#define profiler__concat(x, y) profiler__concat_(x, y)
+	#define profile_zone(name) vtil::profiler::scope_zone profiler__concat(__profile_zone_, __LINE__)( name )
+	#define profile_timer(name, ...) vtil::profiler::scope_timer profiler__concat(__profile_timer_, __LINE__)( name, ##__VA_ARGS__ )
+#else
+	#define profile_zone(...)
+	#define profile_timer(...)
+#endif
\ No newline at end of file
@@ -0,0 +1,152 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#include "thread_registry.hpp"
+#include <mutex>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+#if _WIN64
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <Windows.h>
+#else
+	#include <unistd.h>
+	#include <sys/types.h>
+#endif
+
+namespace vtil::impl
+{
+	// State of the registry.
+	//
+	struct registry_state
+	{
+		std::recursive_mutex mutex;
+		std::vector<uint32_t> free_indices;
+		uint32_t next_index = 0;
+		size_t next_callback_id = 0;
+		std::map<size_t, std::function<void( uint32_t )>> exit_callbacks;
+	};
+	static registry_state& get_registry()
+	{
+		// Intentionally leaked as threads may exit after static destruction.
+		//
+		static registry_state* state = new registry_state();
+		return *state;
+	}
+
+	// Number of times the registry lock is held by the current thread through the guard
+	// below, which covers every path that may invoke arbitrary code under the lock.
+	//
+	static thread_local uint32_t registry_lock_depth = 0;
+	struct registry_guard
+	{
+		std::lock_guard<std::recursive_mutex> lock;
+		registry_guard() : lock( get_registry().mutex ) { registry_lock_depth++; }
+		~registry_guard() { registry_lock_depth--; }
+	};
+
+	// Queries the thread identifier from the OS.
+	//
+	tid_t query_thread_id()
+	{
+#if _WIN64
+		return GetCurrentThreadId();
+#else
+		return ( tid_t ) gettid();
+#endif
+	}
+
+	// Acquires a dense index for the current thread.
+	//
+	thread_entry::thread_entry()
+	{
+		registry_state& registry = get_registry();
+		std::lock_guard g( registry.mutex );
+
+		// Reuse the lowest free index if there is one, otherwise allocate a new one.
+		//
+		if ( !registry.free_indices.empty() )
+		{
+			auto it = std::min_element( registry.free_indices.begin(), registry.free_indices.end() );
+			index = *it;
+			registry.free_indices.erase( it );
+		}
+		else
+		{
+			// If the limit is exceeded, share the overflow index.
+			//
+			index = registry.next_index != max_thread_count ? registry.next_index++ : overflow_thread_index;
+		}
+	}
+
+	// Invokes the exit callbacks and releases the index.
+	//
+	thread_entry::~thread_entry()
+	{
+		registry_state& registry = get_registry();
+		registry_guard g;
+		for ( auto& [id, callback] : registry.exit_callbacks )
+			callback( index );
+		if ( index != overflow_thread_index )
+			registry.free_indices.push_back( index );
+	}
+
+	// Registers a callback invoked with the index of each thread as it exits,
+	// returns an identifier to unregister it with.
+	//
+	size_t register_exit_callback( std::function<void( uint32_t )> callback )
+	{
+		registry_state& registry = get_registry();
+		std::lock_guard g( registry.mutex );
+		size_t id = registry.next_callback_id++;
+		registry.exit_callbacks.emplace( id, std::move( callback ) );
+		return id;
+	}
+	void unregister_exit_callback( size_t id )
+	{
+		registry_state& registry = get_registry();
+		std::lock_guard g( registry.mutex );
+		registry.exit_callbacks.erase( id );
+	}
+
+	// Invokes the callback while holding the lock that guards exit callbacks.
+	//
+	void with_registry_lock( const std::function<void()>& fn )
+	{
+		registry_guard g;
+		fn();
+	}
+
+	// Checks whether the current thread holds the lock that guards exit callbacks.
+	//
+	bool holds_registry_lock()
+	{
+		return registry_lock_depth != 0;
+	}
+};
\ No newline at end of file
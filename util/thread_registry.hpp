@@ -0,0 +1,250 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <intrin.h>
+
+namespace vtil
+{
+	// Thread identifier type.
+	//
+	using tid_t = size_t;
+
+	// Maximum number of threads that can have a dense index at the same time, indices
+	// of threads that exited are reused. Threads created beyond the limit share the
+	// overflow index and their per-thread entries are kept in a map instead.
+	//
+	static constexpr size_t max_thread_count = 1024;
+	static constexpr uint32_t overflow_thread_index = ( uint32_t ) max_thread_count;
+
+	// Implementation details.
+	//
+	namespace impl
+	{
+		// Queries the thread identifier from the OS.
+		//
+		tid_t query_thread_id();
+
+		// Registration of the current thread, acquires a dense index on construction,
+		// invokes the exit callbacks and releases the index on destruction.
+		//
+		struct thread_entry
+		{
+			uint32_t index;
+			thread_entry();
+			~thread_entry();
+		};
+
+		// Registers a callback invoked with the index of each thread as it exits,
+		// returns an identifier to unregister it with.
+		//
+		size_t register_exit_callback( std::function<void( uint32_t )> callback );
+		void unregister_exit_callback( size_t id );
+
+		// Invokes the callback while holding the lock that guards exit callbacks,
+		// used to enumerate per-thread data without racing against thread exits.
+		//
+		void with_registry_lock( const std::function<void()>& fn );
+
+		// Checks whether the current thread holds the lock that guards exit callbacks,
+		// either within with_registry_lock or while exiting.
+		//
+		bool holds_registry_lock();
+	};
+
+	// Returns the thread identifier in a platform independent way,
+	// used instead of std::thread::get_id() as conversion to an integer
+	// requires std::hash...
+	// - Cached in thread-local storage where querying it requires a syscall.
+	//
+	__forceinline static tid_t get_thread_id()
+	{
+#if _WIN64
+		static_assert( sizeof( tid_t ) == 8, "Thread identifier must be defined as a quadword." );
+		return __readgsqword( 0x48 );
+#else
+		static thread_local tid_t tid = impl::query_thread_id();
+		return tid;
+#endif
+	}
+
+	// Returns the dense index of the current thread within [0, max_thread_count),
+	// or overflow_thread_index if the limit was exceeded.
+	//
+	inline uint32_t get_thread_index()
+	{
+		static thread_local impl::thread_entry entry;
+		return entry.index;
+	}
+
+	// Per-thread slots of type T indexed by the thread index, entries are created
+	// lazily on first access by each thread and destroyed when the thread exits.
+	//
+	template<typename T>
+	struct per_thread
+	{
+		// Slot of each thread.
+		//
+		std::atomic<T*> slots[ max_thread_count ] = {};
+
+		// Entries of the threads beyond the limit, keyed by the thread identifier.
+		//
+		std::mutex overflow_mutex;
+		std::unordered_map<tid_t, T*> overflow;
+
+		// Callback invoked with the entry of a thread right before it's destroyed,
+		// can be used to merge the state into a global one.
+		//
+		std::function<void( T& )> on_exit;
+
+		// Identifier of the exit callback.
+		//
+		size_t callback_id;
+
+		// Constructed with an optional exit callback, copying or moving this object is not allowed.
+		//
+		per_thread( std::function<void( T& )> on_exit = {} ) : on_exit( std::move( on_exit ) )
+		{
+			callback_id = impl::register_exit_callback( [ this ] ( uint32_t idx ) { release( idx ); } );
+		}
+		per_thread( per_thread&& ) = delete;
+		per_thread( const per_thread& ) = delete;
+		per_thread& operator=( per_thread&& ) = delete;
+		per_thread& operator=( const per_thread& ) = delete;
+		~per_thread()
+		{
+			impl::unregister_exit_callback( callback_id );
+			for ( auto& slot : slots )
+				delete slot.exchange( nullptr );
+			for ( auto& [tid, entry] : overflow )
+				delete entry;
+		}
+
+		// Returns the entry of the current thread, creating it if not done already.
+		//
+		T& local()
+		{
+			uint32_t idx = get_thread_index();
+			if ( idx == overflow_thread_index ) [[unlikely]]
+			{
+				std::lock_guard g( overflow_mutex );
+				T*& entry = overflow[ get_thread_id() ];
+				if ( !entry )
+					entry = new T();
+				return *entry;
+			}
+
+			std::atomic<T*>& slot = slots[ idx ];
+			T* entry = slot.load( std::memory_order_acquire );
+			if ( !entry )
+			{
+				entry = new T();
+				slot.store( entry, std::memory_order_release );
+			}
+			return *entry;
+		}
+
+		// Returns the entry of the current thread if it was created already, nullptr otherwise.
+		//
+		T* find()
+		{
+			uint32_t idx = get_thread_index();
+			if ( idx == overflow_thread_index ) [[unlikely]]
+			{
+				std::lock_guard g( overflow_mutex );
+				auto it = overflow.find( get_thread_id() );
+				return it != overflow.end() ? it->second : nullptr;
+			}
+			return slots[ idx ].load( std::memory_order_acquire );
+		}
+		T* operator->() { return &local(); }
+		T& operator*() { return local(); }
+
+		// Enumerates the entries of every thread alive.
+		//
+		template<typename fn_type>
+		void for_each( fn_type&& fn )
+		{
+			impl::with_registry_lock( [ & ] ()
+			{
+				for ( auto& slot : slots )
+					if ( T* entry = slot.load( std::memory_order_acquire ) )
+						fn( *entry );
+
+				std::lock_guard g( overflow_mutex );
+				for ( auto& [tid, entry] : overflow )
+					fn( *entry );
+			} );
+		}
+
+		// Enumerates the entries without acquiring the registry lock, only used on paths
+		// that must not block such as fatal errors, as entries may be released meanwhile.
+		//
+		template<typename fn_type>
+		void for_each_unlocked( fn_type&& fn )
+		{
+			for ( auto& slot : slots )
+				if ( T* entry = slot.load( std::memory_order_acquire ) )
+					fn( *entry );
+
+			if ( overflow_mutex.try_lock() )
+			{
+				for ( auto& [tid, entry] : overflow )
+					fn( *entry );
+				overflow_mutex.unlock();
+			}
+		}
+
+		// Destroys the entry of the given thread, invoked on the exiting thread.
+		//
+		void release( uint32_t idx )
+		{
+			T* entry = nullptr;
+			if ( idx == overflow_thread_index )
+			{
+				std::lock_guard g( overflow_mutex );
+				if ( auto it = overflow.find( get_thread_id() ); it != overflow.end() )
+					entry = it->second, overflow.erase( it );
+			}
+			else
+			{
+				entry = slots[ idx ].exchange( nullptr );
+			}
+
+			if ( entry )
+			{
+				if ( on_exit ) on_exit( *entry );
+				delete entry;
+			}
+		}
+	};
+};
\ No newline at end of file
@@ -0,0 +1,186 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of mosquitto nor the names of its   
+//    contributors may be used to endorse or promote products derived from   
+//    this software without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <intrin.h>
+#include "thread_registry.hpp"
+
+// Profiling zones are compiled out unless VTIL_PROFILER is explicitly
+// defined as a non-zero value, the types below are still declared so that
+// code referencing them directly does not have to be guarded.
+//
+#ifndef VTIL_PROFILER
+	#define VTIL_PROFILER 0
+#endif
+
+// Zones are timed scopes recorded into per-thread buffers, they are consumed by
+// the profiler to build call trees and exported as trace events.
+//
+namespace vtil::profiler
+{
+	// Timestamps are read from the TSC, they are converted to real time
+	// only when the results are being reported.
+	//
+	using tsc_t = uint64_t;
+	__forceinline static tsc_t timestamp() { return __rdtsc(); }
+
+	// Returns the number of TSC ticks per second, calibrated against the
+	// steady clock upon the first call.
+	//
+	double ticks_per_second();
+
+	// Converts the number of ticks given into milliseconds.
+	//
+	inline static double to_ms( tsc_t ticks ) { return ticks * 1000.0 / ticks_per_second(); }
+
+	// Record describing a single completed zone.
+	//
+	struct zone_record
+	{
+		const char* name;
+		uint32_t depth;
+		tsc_t begin;
+		tsc_t end;
+	};
+
+	// Slot of the ring buffer, guarded by a sequence number so that other threads can
+	// read it while the owning thread is overwriting it.
+	// - Sequence is odd while the record is being written and 2 * (index + 1) once 
+	//   the record with the given index is complete.
+	//
+	struct zone_slot
+	{
+		std::atomic<size_t> sequence = 0;
+		std::atomic<const char*> name = nullptr;
+		std::atomic<uint32_t> depth = 0;
+		std::atomic<tsc_t> begin = 0;
+		std::atomic<tsc_t> end = 0;
+	};
+
+	// Per-thread ring buffer of completed zones, once the buffer is full the
+	// oldest records are overwritten.
+	//
+	struct thread_buffer
+	{
+		static constexpr size_t capacity = 1 << 12;
+
+		// Identifier of the owning thread and the current nesting depth.
+		//
+		tid_t thread_id = 0;
+		uint32_t depth = 0;
+
+		// Number of records written since the creation, only ever incremented
+		// by the owning thread.
+		//
+		std::atomic<size_t> write_index = 0;
+
+		// Records below this index were discarded by a reset.
+		//
+		std::atomic<size_t> reset_index = 0;
+		zone_slot records[ capacity ];
+
+		// Pushes a new record, only ever called by the owning thread.
+		//
+		__forceinline void push( const zone_record& record )
+		{
+			size_t idx = write_index.load( std::memory_order_relaxed );
+			zone_slot& slot = records[ idx % capacity ];
+			slot.sequence.store( 2 * idx + 1, std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_release );
+			slot.name.store( record.name, std::memory_order_relaxed );
+			slot.depth.store( record.depth, std::memory_order_relaxed );
+			slot.begin.store( record.begin, std::memory_order_relaxed );
+			slot.end.store( record.end, std::memory_order_relaxed );
+			slot.sequence.store( 2 * idx + 2, std::memory_order_release );
+			write_index.store( idx + 1, std::memory_order_release );
+		}
+
+		// Reads the record with the given index, returns false if it was
+		// overwritten or is being written at the moment.
+		//
+		bool read( size_t idx, zone_record& out ) const
+		{
+			const zone_slot& slot = records[ idx % capacity ];
+			size_t sequence = slot.sequence.load( std::memory_order_acquire );
+			if ( sequence != 2 * idx + 2 )
+				return false;
+			out.name = slot.name.load( std::memory_order_relaxed );
+			out.depth = slot.depth.load( std::memory_order_relaxed );
+			out.begin = slot.begin.load( std::memory_order_relaxed );
+			out.end = slot.end.load( std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_acquire );
+			return slot.sequence.load( std::memory_order_relaxed ) == sequence;
+		}
+	};
+
+	// Implementation details.
+	//
+	namespace impl
+	{
+		// Allocates a new buffer for the current thread and registers it.
+		//
+		thread_buffer* register_thread();
+	};
+
+	// Returns the buffer of the current thread, allocating it if not done already.
+	//
+	__forceinline static thread_buffer* local_buffer()
+	{
+		static thread_local thread_buffer* buffer = impl::register_thread();
+		return buffer;
+	}
+
+	// RAII zone recording the time spent until the scope ends.
+	//
+	struct scope_zone
+	{
+		thread_buffer* buffer;
+		const char* name;
+		uint32_t depth;
+		tsc_t begin;
+		bool active = true;
+
+		scope_zone( const char* name ) : buffer( local_buffer() ), name( name ), depth( buffer->depth++ ), begin( timestamp() ) {}
+		~scope_zone() { end(); }
+
+		// Ends the zone early if not done already, returns the number of ticks elapsed.
+		//
+		tsc_t end()
+		{
+			tsc_t ts = timestamp();
+			if ( active )
+			{
+				buffer->push( { name, depth, begin, ts } );
+				buffer->depth--;
+				active = false;
+			}
+			return ts - begin;
+		}
+	};
+};
\ No newline at end of file